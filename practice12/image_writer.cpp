@@ -0,0 +1,149 @@
+#include "image_writer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+	std::ofstream open(std::filesystem::path const & path)
+	{
+		std::ofstream output(path, std::ios::binary);
+		if (!output)
+			throw std::runtime_error("Failed to open " + path.string() + " for writing");
+		return output;
+	}
+
+	void close(std::ofstream & output, std::filesystem::path const & path)
+	{
+		output.close();
+		if (!output)
+			throw std::runtime_error("Failed to write " + path.string());
+	}
+
+	// RGB rows top to bottom
+	std::vector<std::uint8_t> rgb_rows(int width, int height, std::uint32_t const * pixels, bool png_filter_bytes)
+	{
+		std::vector<std::uint8_t> result;
+		result.reserve(std::size_t(height) * (3 * width + 1));
+		for (int y = height - 1; y >= 0; --y)
+		{
+			// PNG prefixes every row with its filter type, 0 for none
+			if (png_filter_bytes)
+				result.push_back(0);
+			for (int x = 0; x < width; ++x)
+			{
+				std::uint32_t const p = pixels[std::size_t(y) * width + x];
+				result.push_back(p & 0xff);
+				result.push_back((p >> 8) & 0xff);
+				result.push_back((p >> 16) & 0xff);
+			}
+		}
+		return result;
+	}
+
+	std::array<std::uint32_t, 256> const crc_table = []
+	{
+		std::array<std::uint32_t, 256> table;
+		for (std::uint32_t n = 0; n < 256; ++n)
+		{
+			std::uint32_t c = n;
+			for (int k = 0; k < 8; ++k)
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+		return table;
+	}();
+
+	void put_u32(std::vector<std::uint8_t> & data, std::uint32_t value)
+	{
+		for (int shift = 24; shift >= 0; shift -= 8)
+			data.push_back((value >> shift) & 0xff);
+	}
+
+	void write_chunk(std::ofstream & output, char const (& type)[5], std::vector<std::uint8_t> const & data)
+	{
+		std::vector<std::uint8_t> chunk;
+		put_u32(chunk, data.size());
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+
+		// Over the type and the data, not the length
+		std::uint32_t crc = 0xffffffffu;
+		for (std::size_t i = 4; i < chunk.size(); ++i)
+			crc = crc_table[(crc ^ chunk[i]) & 0xff] ^ (crc >> 8);
+		put_u32(chunk, crc ^ 0xffffffffu);
+
+		output.write(reinterpret_cast<char const *>(chunk.data()), chunk.size());
+	}
+
+	// Zlib stream of uncompressed deflate blocks: reference images favour simplicity over size
+	std::vector<std::uint8_t> zlib_store(std::vector<std::uint8_t> const & data)
+	{
+		constexpr std::size_t max_block = 65535;
+
+		std::vector<std::uint8_t> result{0x78, 0x01};
+		std::size_t offset = 0;
+		do
+		{
+			std::size_t const size = std::min(max_block, data.size() - offset);
+			bool const last = offset + size == data.size();
+			result.push_back(last ? 1 : 0);
+			result.push_back(size & 0xff);
+			result.push_back(size >> 8);
+			result.push_back(~size & 0xff);
+			result.push_back((~size >> 8) & 0xff);
+			result.insert(result.end(), data.begin() + offset, data.begin() + offset + size);
+			offset += size;
+		}
+		while (offset < data.size());
+
+		std::uint32_t a = 1, b = 0;
+		for (auto byte : data)
+		{
+			a = (a + byte) % 65521;
+			b = (b + a) % 65521;
+		}
+		put_u32(result, (b << 16) | a);
+		return result;
+	}
+
+}
+
+void write_ppm(std::filesystem::path const & path, int width, int height, std::uint32_t const * pixels)
+{
+	auto output = open(path);
+	output << "P6\n" << width << " " << height << "\n255\n";
+	auto const rows = rgb_rows(width, height, pixels, false);
+	output.write(reinterpret_cast<char const *>(rows.data()), rows.size());
+	close(output, path);
+}
+
+void write_png(std::filesystem::path const & path, int width, int height, std::uint32_t const * pixels)
+{
+	auto output = open(path);
+	output.write("\x89PNG\r\n\x1a\n", 8);
+
+	std::vector<std::uint8_t> header;
+	put_u32(header, width);
+	put_u32(header, height);
+	// 8 bits per channel, RGB, default compression, filtering and no interlacing
+	header.insert(header.end(), {8, 2, 0, 0, 0});
+	write_chunk(output, "IHDR", header);
+
+	write_chunk(output, "IDAT", zlib_store(rgb_rows(width, height, pixels, true)));
+	write_chunk(output, "IEND", {});
+	close(output, path);
+}
+
+void write_image(std::filesystem::path const & path, int width, int height, std::uint32_t const * pixels)
+{
+	if (path.extension() == ".ppm")
+		write_ppm(path, width, height, pixels);
+	else
+		write_png(path, width, height, pixels);
+}
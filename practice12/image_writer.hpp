@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+// Pixels are RGBA8 with red in the lowest byte, bottom row first as OpenGL reads them back;
+// alpha is dropped. Both throw std::runtime_error if the file cannot be written
+void write_ppm(std::filesystem::path const & path, int width, int height, std::uint32_t const * pixels);
+void write_png(std::filesystem::path const & path, int width, int height, std::uint32_t const * pixels);
+
+// Picks the format from the extension, PNG unless it is .ppm
+void write_image(std::filesystem::path const & path, int width, int height, std::uint32_t const * pixels);
@@ -28,6 +28,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
+#include "volume.hpp"
 #include "stb_image.h"
 
 std::string to_string(std::string_view str)
@@ -73,6 +74,12 @@ uniform vec3 light_direction;
 uniform vec3 bbox_min;
 uniform vec3 bbox_max;
 
+uniform sampler3D density_texture;
+uniform sampler3D macro_texture;
+uniform vec3 macro_cell_extent;
+uniform float step_size;
+uniform float light_lod;
+
 layout (location = 0) out vec4 out_color;
 
 void sort(inout float x, inout float y)
@@ -109,11 +116,80 @@ vec2 intersect_bbox(vec3 origin, vec3 direction)
 
 const float PI = 3.1415926535;
 
+const float absorption = 1.0;
+const float scattering = 4.0;
+const float extinction = absorption + scattering;
+const vec3 light_color = vec3(16.0);
+
 in vec3 position;
 
+vec3 texcoord(vec3 p)
+{
+    return (p - bbox_min) / (bbox_max - bbox_min);
+}
+
+// First sample at or after t that doesn't lie in an empty macro cell. Empty cells are skipped
+// by whole steps, so the samples taken are exactly those of the plain uniform march
+float skip_empty(vec3 origin, vec3 direction, float t, float t_end, float step)
+{
+    ivec3 macro_size = textureSize(macro_texture, 0);
+
+    while (t < t_end)
+    {
+        vec3 p = origin + t * direction;
+        ivec3 cell = clamp(ivec3(floor((p - bbox_min) / macro_cell_extent)), ivec3(0), macro_size - 1);
+        if (texelFetch(macro_texture, cell, 0).g > 0.0)
+            break;
+
+        vec3 cell_min = bbox_min + vec3(cell) * macro_cell_extent;
+        vec3 t1 = (cell_min - origin) / direction;
+        vec3 t2 = (cell_min + macro_cell_extent - origin) / direction;
+        float t_exit = vmin(max(t1, t2));
+
+        t += max(ceil((t_exit - t) / step), 1.0) * step;
+    }
+
+    return t;
+}
+
+// The macro cells account for the voxels read at light_lod, so skipping is exact here as well
+float light_optical_depth(vec3 p)
+{
+    float t_end = intersect_bbox(p, light_direction).y;
+    float step = 2.0 * step_size;
+
+    float density = 0.0;
+    for (float t = skip_empty(p, light_direction, 0.5 * step, t_end, step); t < t_end;
+        t = skip_empty(p, light_direction, t + step, t_end, step))
+    {
+        density += textureLod(density_texture, texcoord(p + t * light_direction), light_lod).r;
+    }
+
+    return extinction * density * step;
+}
+
 void main()
 {
-    out_color = vec4(1.0, 0.5, 0.5, 1.0);
+    vec3 direction = normalize(position - camera_position);
+    vec2 t = intersect_bbox(camera_position, direction);
+    float t_min = max(t.x, 0.0);
+    float t_max = t.y;
+
+    float optical_depth = 0.0;
+    vec3 color = vec3(0.0);
+
+    for (float s = skip_empty(camera_position, direction, t_min + 0.5 * step_size, t_max, step_size); s < t_max;
+        s = skip_empty(camera_position, direction, s + step_size, t_max, step_size))
+    {
+        vec3 p = camera_position + s * direction;
+        float density = textureLod(density_texture, texcoord(p), 0.0).r;
+
+        optical_depth += extinction * density * step_size;
+        color += light_color * exp(-light_optical_depth(p)) * exp(-optical_depth) * step_size * density * scattering / (4.0 * PI);
+    }
+
+    // Premultiplied by the opacity
+    out_color = vec4(color, 1.0 - exp(-optical_depth));
 }
 )";
 
@@ -236,6 +312,11 @@ int main() try
     GLuint bbox_max_location = glGetUniformLocation(program, "bbox_max");
     GLuint camera_position_location = glGetUniformLocation(program, "camera_position");
     GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
+    GLuint density_texture_location = glGetUniformLocation(program, "density_texture");
+    GLuint macro_texture_location = glGetUniformLocation(program, "macro_texture");
+    GLuint macro_cell_extent_location = glGetUniformLocation(program, "macro_cell_extent");
+    GLuint step_size_location = glGetUniformLocation(program, "step_size");
+    GLuint light_lod_location = glGetUniformLocation(program, "light_lod");
 
     GLuint vao, vbo, ebo;
     glGenVertexArrays(1, &vao);
@@ -258,6 +339,39 @@ int main() try
     const glm::vec3 cloud_bbox_min{-2.f, -1.f, -1.f};
     const glm::vec3 cloud_bbox_max{ 2.f,  1.f,  1.f};
 
+    // Light rays take twice as long steps through the half resolution level
+    float step_size = 0.02f;
+    float light_lod = 1.f;
+
+    const volume_data cloud = load_volume(cloud_data_path, {128, 64, 64}, 8, std::ceil(light_lod));
+
+    // Rows of levels 6 and 7 (2 and 1 voxels wide) are narrower than the default 4 byte alignment
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    GLuint density_texture;
+    glGenTextures(1, &density_texture);
+    glBindTexture(GL_TEXTURE_3D, density_texture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    for (std::size_t level = 0; level < cloud.levels.size(); ++level)
+    {
+        auto const & size = cloud.level_sizes[level];
+        glTexImage3D(GL_TEXTURE_3D, level, GL_R8, size[0], size[1], size[2], 0, GL_RED, GL_UNSIGNED_BYTE, cloud.levels[level].data());
+    }
+
+    GLuint macro_texture;
+    glGenTextures(1, &macro_texture);
+    glBindTexture(GL_TEXTURE_3D, macro_texture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RG8, cloud.macro_size[0], cloud.macro_size[1], cloud.macro_size[2], 0, GL_RG, GL_UNSIGNED_BYTE, cloud.macro_cells.data());
+
+    const glm::vec3 cloud_macro_cell_extent = (cloud_bbox_max - cloud_bbox_min) * float(cloud.macro_cell_size)
+        / glm::vec3(cloud.size()[0], cloud.size()[1], cloud.size()[2]);
+
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
     float time = 0.f;
@@ -332,7 +446,7 @@ int main() try
         glCullFace(GL_FRONT);
 
         glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
         float near = 0.1f;
         float far = 100.f;
@@ -357,6 +471,16 @@ int main() try
         glUniform3fv(bbox_max_location, 1, reinterpret_cast<const float *>(&cloud_bbox_max));
         glUniform3fv(camera_position_location, 1, reinterpret_cast<float *>(&camera_position));
         glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
+        glUniform3fv(macro_cell_extent_location, 1, reinterpret_cast<const float *>(&cloud_macro_cell_extent));
+        glUniform1f(step_size_location, step_size);
+        glUniform1f(light_lod_location, light_lod);
+        glUniform1i(density_texture_location, 0);
+        glUniform1i(macro_texture_location, 1);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, density_texture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, macro_texture);
 
         glBindVertexArray(vao);
         glDrawElements(GL_TRIANGLES, std::size(cube_indices), GL_UNSIGNED_INT, nullptr);
@@ -0,0 +1,117 @@
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/geometric.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include "volume.hpp"
+#include "volume_renderer.hpp"
+#include "image_writer.hpp"
+#include "thread_pool.hpp"
+
+// Renders cloud.data headlessly with the CPU reference raymarcher, from the initial camera of main.cpp:
+//   render <output.png|output.ppm> [width height] [threads] [step_size light_lod] [time] [noskip]
+// time sets the light direction as main.cpp does after that many seconds; noskip marches empty cells too.
+// With skipping, the image is rendered without it first, and the two must match
+int main(int argc, char ** argv) try
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <output.png|output.ppm> [width height] [threads] [step_size light_lod] [time] [noskip]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::path const output_path = argv[1];
+
+    int const width = argc > 3 ? std::stoi(argv[2]) : 800;
+    int const height = argc > 3 ? std::stoi(argv[3]) : 600;
+    unsigned int const threads = argc > 4 ? std::stoi(argv[4]) : std::thread::hardware_concurrency();
+
+    volume_render_settings settings;
+    if (argc > 6)
+    {
+        settings.step_size = std::stof(argv[5]);
+        settings.light_lod = std::stof(argv[6]);
+    }
+
+    float const time = argc > 7 ? std::stof(argv[7]) : 0.f;
+    settings.light_direction = glm::normalize(glm::vec3(std::cos(time), 1.f, std::sin(time)));
+    settings.skip_empty = !(argc > 8 && std::string(argv[8]) == "noskip");
+
+    const std::string project_root = PROJECT_ROOT;
+    const volume_data cloud = load_volume(project_root + "/cloud.data", {128, 64, 64}, 8, std::ceil(settings.light_lod));
+
+    float const view_angle = glm::pi<float>() / 6.f;
+    float const camera_distance = 3.5f;
+    float const camera_rotation = glm::pi<float>() / 6.f;
+
+    glm::mat4 view(1.f);
+    view = glm::translate(view, {0.f, 0.f, -camera_distance});
+    view = glm::rotate(view, view_angle, {1.f, 0.f, 0.f});
+    view = glm::rotate(view, camera_rotation, {0.f, 1.f, 0.f});
+
+    glm::mat4 const projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, 0.1f, 100.f);
+
+    thread_pool pool(threads);
+    std::vector<std::uint32_t> pixels(width * height);
+
+    auto render = [&](volume_render_settings const & settings, volume_render_stats & stats)
+    {
+        auto const start = std::chrono::high_resolution_clock::now();
+        stats = render_volume(pool, cloud, settings, view, projection, width, height, pixels.data());
+        auto const end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    };
+
+    auto checksum = [&]
+    {
+        std::uint64_t result = 0;
+        for (auto pixel : pixels)
+            result = result * 31 + (pixel & 0xffffff);
+        return result;
+    };
+
+    // Skipping only leaves out samples of zero density, so the image must not change without it
+    std::uint64_t plain_checksum = 0;
+    double plain_time = 0.0;
+    if (settings.skip_empty)
+    {
+        volume_render_settings plain = settings;
+        plain.skip_empty = false;
+        volume_render_stats plain_stats;
+        plain_time = render(plain, plain_stats);
+        plain_checksum = checksum();
+    }
+
+    volume_render_stats stats;
+    double const render_time = render(settings, stats);
+    std::uint64_t const image_checksum = checksum();
+
+    write_image(output_path, width, height, pixels.data());
+
+    std::cout << "Rendered " << width << "x" << height << " with " << pool.thread_count() << " threads in "
+        << render_time << " ms to " << output_path.string() << std::endl;
+    std::cout << "    " << double(stats.samples) / (width * height) << " samples and " << double(stats.light_samples) / (width * height)
+        << " light samples per pixel, " << stats.skipped_cells << " empty cells skipped (checksum " << image_checksum << ")" << std::endl;
+
+    if (settings.skip_empty)
+    {
+        std::cout << "    Without skipping: " << plain_time << " ms, checksum " << plain_checksum << std::endl;
+        if (plain_checksum != image_checksum)
+            throw std::runtime_error("Skipping empty cells changed the image");
+    }
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Work-stealing pool: every participant owns a contiguous range of chunks, takes chunks
+// from its front and steals from the back of other participants' ranges once it runs dry
+struct thread_pool
+{
+	// thread_count includes the calling thread, which also executes chunks
+	explicit thread_pool(unsigned int thread_count = std::thread::hardware_concurrency());
+	~thread_pool();
+
+	thread_pool(thread_pool const &) = delete;
+	thread_pool & operator = (thread_pool const &) = delete;
+
+	unsigned int thread_count() const
+	{
+		return workers.size() + 1;
+	}
+
+	// Number of chunks executed by a participant other than the one owning them, since construction
+	std::size_t steal_count() const
+	{
+		return steals.load();
+	}
+
+	// Calls f(begin, end) or f(begin, end, worker) for chunks of [0, count) and waits for all of them;
+	// worker is in [0, thread_count()), 0 being the calling thread. Must not be called recursively from inside f
+	template <typename F>
+	void parallel_for(std::size_t count, std::size_t chunk_size, F && f)
+	{
+		using function_type = std::remove_reference_t<F>;
+		run(count, chunk_size, [](void * context, std::size_t begin, std::size_t end, unsigned int worker){
+			auto & function = *static_cast<function_type *>(context);
+			if constexpr (std::is_invocable_v<function_type &, std::size_t, std::size_t, unsigned int>)
+				function(begin, end, worker);
+			else
+				function(begin, end);
+		}, const_cast<std::remove_const_t<function_type> *>(&f));
+	}
+
+private:
+	using task_function = void (*)(void *, std::size_t, std::size_t, unsigned int);
+
+	// Chunk indices [begin, end) packed into one word so that the owner and thieves can race on it
+	struct alignas(64) chunk_range
+	{
+		std::atomic<std::uint64_t> range{0};
+	};
+
+	void run(std::size_t count, std::size_t chunk_size, task_function function, void * context);
+	bool pop_front(unsigned int worker, std::uint32_t & chunk);
+	bool steal_back(unsigned int victim, std::uint32_t & chunk);
+	void execute_chunks(unsigned int worker);
+	void worker_loop(unsigned int worker);
+
+	std::vector<std::thread> workers;
+	std::vector<chunk_range> ranges;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::uint64_t generation = 0;
+	unsigned int busy = 0;
+	bool stop = false;
+
+	task_function function = nullptr;
+	void * context = nullptr;
+	std::size_t count = 0;
+	std::size_t chunk_size = 1;
+	std::atomic<std::size_t> steals{0};
+};
@@ -0,0 +1,142 @@
+#include "volume.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+    void build_levels(volume_data & volume)
+    {
+        while (true)
+        {
+            auto const & s = volume.level_sizes.back();
+            if (s[0] == 1 && s[1] == 1 && s[2] == 1)
+                break;
+
+            volume_data::size_type const next{std::max(s[0] / 2, 1), std::max(s[1] / 2, 1), std::max(s[2] / 2, 1)};
+            std::vector<std::uint8_t> density(std::size_t(next[0]) * next[1] * next[2]);
+
+            int const level = volume.levels.size() - 1;
+            for (int z = 0; z < next[2]; ++z)
+            {
+                for (int y = 0; y < next[1]; ++y)
+                {
+                    for (int x = 0; x < next[0]; ++x)
+                    {
+                        // An axis that is already 1 voxel wide reads the same voxel twice
+                        int sum = 0;
+                        for (int dz = 0; dz < 2; ++dz)
+                        {
+                            for (int dy = 0; dy < 2; ++dy)
+                            {
+                                for (int dx = 0; dx < 2; ++dx)
+                                {
+                                    sum += volume.voxel(level,
+                                        std::min(2 * x + dx, s[0] - 1),
+                                        std::min(2 * y + dy, s[1] - 1),
+                                        std::min(2 * z + dz, s[2] - 1));
+                                }
+                            }
+                        }
+
+                        density[x + next[0] * (y + next[1] * z)] = (sum + 4) / 8;
+                    }
+                }
+            }
+
+            volume.level_sizes.push_back(next);
+            volume.levels.push_back(std::move(density));
+        }
+    }
+
+    // Level 0 voxels along one axis that trilinear fetches of levels up to lod read at positions
+    // between begin and end, in voxels. A level l texel j averages voxels j * 2^l to (j + 1) * 2^l - 1
+    std::array<int, 2> voxels_read(volume_data const & volume, int axis, float begin, float end, int lod)
+    {
+        int const size = volume.size()[axis];
+        std::array<int, 2> result{size, 0};
+
+        for (int level = 0; level <= std::min<int>(lod, volume.levels.size() - 1); ++level)
+        {
+            int const level_size = volume.level_sizes[level][axis];
+            float const scale = float(level_size) / size;
+
+            int const first = std::clamp(int(std::floor(begin * scale - 0.5f)), 0, level_size - 1);
+            int const last = std::clamp(int(std::floor(end * scale - 0.5f)) + 1, 0, level_size - 1);
+
+            result[0] = std::min(result[0], first << level);
+            result[1] = std::max(result[1], std::min(((last + 1) << level) - 1, size - 1));
+        }
+
+        return result;
+    }
+
+    void build_macro_cells(volume_data & volume)
+    {
+        auto const & s = volume.size();
+        int const c = volume.macro_cell_size;
+
+        for (int i = 0; i < 3; ++i)
+            volume.macro_size[i] = (s[i] + c - 1) / c;
+
+        volume.macro_cells.resize(std::size_t(volume.macro_size[0]) * volume.macro_size[1] * volume.macro_size[2]);
+
+        for (int cz = 0; cz < volume.macro_size[2]; ++cz)
+        {
+            auto const z = voxels_read(volume, 2, cz * c, (cz + 1) * c, volume.macro_lod);
+            for (int cy = 0; cy < volume.macro_size[1]; ++cy)
+            {
+                auto const y = voxels_read(volume, 1, cy * c, (cy + 1) * c, volume.macro_lod);
+                for (int cx = 0; cx < volume.macro_size[0]; ++cx)
+                {
+                    auto const x = voxels_read(volume, 0, cx * c, (cx + 1) * c, volume.macro_lod);
+
+                    volume_data::macro_cell cell{255, 0};
+                    for (int vz = z[0]; vz <= z[1]; ++vz)
+                    {
+                        for (int vy = y[0]; vy <= y[1]; ++vy)
+                        {
+                            for (int vx = x[0]; vx <= x[1]; ++vx)
+                            {
+                                std::uint8_t const d = volume.voxel(0, vx, vy, vz);
+                                cell.min = std::min(cell.min, d);
+                                cell.max = std::max(cell.max, d);
+                            }
+                        }
+                    }
+
+                    volume.macro_cells[cx + volume.macro_size[0] * (cy + volume.macro_size[1] * cz)] = cell;
+                }
+            }
+        }
+    }
+
+}
+
+volume_data load_volume(std::filesystem::path const & path, volume_data::size_type const & size, int macro_cell_size, int macro_lod)
+{
+    std::size_t const voxel_count = std::size_t(size[0]) * size[1] * size[2];
+
+    std::ifstream is(path, std::ios::binary);
+    if (!is)
+        throw std::runtime_error("Failed to open volume " + path.string());
+
+    volume_data result;
+    result.level_sizes.push_back(size);
+    result.levels.emplace_back(voxel_count);
+
+    is.read(reinterpret_cast<char *>(result.levels[0].data()), voxel_count);
+    if (std::size_t(is.gcount()) != voxel_count || is.peek() != std::ifstream::traits_type::eof())
+        throw std::runtime_error("Volume " + path.string() + " doesn't match its expected size");
+
+    result.macro_cell_size = macro_cell_size;
+    result.macro_lod = macro_lod;
+
+    build_levels(result);
+    build_macro_cells(result);
+
+    return result;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+// Raw 8-bit density volume (x varying fastest, then y, then z) with the structures used to raymarch it
+struct volume_data
+{
+    using size_type = std::array<int, 3>;
+
+    // Density pyramid: levels[0] is the volume as loaded, every next level averages 2x2x2 voxels of the
+    // previous one, down to a single voxel. Sizes follow the GL mip chain, so the levels upload as they are
+    std::vector<size_type> level_sizes;
+    std::vector<std::vector<std::uint8_t>> levels;
+
+    // Macro cells of macro_cell_size^3 voxels, with the minimum and maximum density of the level 0 voxels
+    // that trilinear samples inside the cell read at levels up to macro_lod: the cell grown by one voxel
+    // on each side at level 0, by three at level 1. A cell with max == 0 reads zero density at all of
+    // these levels, so samples in it can be skipped; uploads as an RG8 texture
+    struct macro_cell
+    {
+        std::uint8_t min;
+        std::uint8_t max;
+    };
+
+    int macro_cell_size;
+    int macro_lod;
+    size_type macro_size;
+    std::vector<macro_cell> macro_cells;
+
+    size_type const & size() const
+    {
+        return level_sizes[0];
+    }
+
+    std::uint8_t voxel(int level, int x, int y, int z) const
+    {
+        auto const & s = level_sizes[level];
+        return levels[level][x + s[0] * (y + s[1] * z)];
+    }
+
+    macro_cell const & cell(int x, int y, int z) const
+    {
+        return macro_cells[x + macro_size[0] * (y + macro_size[1] * z)];
+    }
+};
+
+// Throws if the file doesn't hold exactly size[0] * size[1] * size[2] bytes. macro_lod is the
+// highest level sampled where empty macro cells are skipped, at least the ceiling of the light LOD
+volume_data load_volume(std::filesystem::path const & path, volume_data::size_type const & size, int macro_cell_size = 8, int macro_lod = 0);
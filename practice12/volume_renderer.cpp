@@ -0,0 +1,422 @@
+#include "volume_renderer.hpp"
+
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <glm/vec2.hpp>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+    constexpr int packet_size = 8;
+    constexpr int tile_size = 16;
+
+    // Same constants as the shader
+    constexpr float absorption = 1.f;
+    constexpr float scattering = 4.f;
+    constexpr float extinction = absorption + scattering;
+    constexpr float light_intensity = 16.f;
+
+    // Eight lanes of a ray packet; lane loops only remain for the volume fetches and exp
+#ifdef __AVX__
+
+    struct float8
+    {
+        __m256 v;
+
+        float8(__m256 v) : v(v) {}
+        float8(float x) : v(_mm256_set1_ps(x)) {}
+
+        static float8 load(float const * p)
+        {
+            return _mm256_load_ps(p);
+        }
+
+        void store(float * p) const
+        {
+            _mm256_store_ps(p, v);
+        }
+    };
+
+    float8 operator + (float8 a, float8 b) { return _mm256_add_ps(a.v, b.v); }
+    float8 operator - (float8 a, float8 b) { return _mm256_sub_ps(a.v, b.v); }
+    float8 operator * (float8 a, float8 b) { return _mm256_mul_ps(a.v, b.v); }
+    float8 floor(float8 a) { return _mm256_floor_ps(a.v); }
+
+    unsigned int positive_mask(float8 a)
+    {
+        return _mm256_movemask_ps(_mm256_cmp_ps(a.v, _mm256_setzero_ps(), _CMP_GT_OQ));
+    }
+
+#else
+
+    struct float8
+    {
+        float v[packet_size];
+
+        float8(float x)
+        {
+            std::fill(v, v + packet_size, x);
+        }
+
+        static float8 load(float const * p)
+        {
+            float8 result(0.f);
+            std::copy(p, p + packet_size, result.v);
+            return result;
+        }
+
+        void store(float * p) const
+        {
+            std::copy(v, v + packet_size, p);
+        }
+    };
+
+    template <typename F>
+    float8 lanewise(float8 a, float8 b, F && f)
+    {
+        for (int i = 0; i < packet_size; ++i)
+            a.v[i] = f(a.v[i], b.v[i]);
+        return a;
+    }
+
+    float8 operator + (float8 a, float8 b) { return lanewise(a, b, [](float x, float y){ return x + y; }); }
+    float8 operator - (float8 a, float8 b) { return lanewise(a, b, [](float x, float y){ return x - y; }); }
+    float8 operator * (float8 a, float8 b) { return lanewise(a, b, [](float x, float y){ return x * y; }); }
+    float8 floor(float8 a) { return lanewise(a, a, [](float x, float){ return std::floor(x); }); }
+
+    unsigned int positive_mask(float8 a)
+    {
+        unsigned int result = 0;
+        for (int i = 0; i < packet_size; ++i)
+            result |= (a.v[i] > 0.f) << i;
+        return result;
+    }
+
+#endif
+
+    float8 exp(float8 a)
+    {
+        alignas(32) float values[packet_size];
+        a.store(values);
+        for (float & x : values)
+            x = std::exp(x);
+        return float8::load(values);
+    }
+
+    float vmin(glm::vec3 const & v)
+    {
+        return std::min({v.x, v.y, v.z});
+    }
+
+    float vmax(glm::vec3 const & v)
+    {
+        return std::max({v.x, v.y, v.z});
+    }
+
+    struct renderer
+    {
+        volume_data const & volume;
+        volume_render_settings const & settings;
+        glm::vec3 bbox_size;
+        glm::vec3 macro_cell_extent;
+        glm::vec3 inverse_macro_cell_extent;
+
+        // Entry and exit distances of the ray through the bounding box, as intersect_bbox in the shader
+        glm::vec2 intersect_bbox(glm::vec3 const & origin, glm::vec3 const & direction) const
+        {
+            glm::vec3 const t1 = (settings.bbox_min - origin) / direction;
+            glm::vec3 const t2 = (settings.bbox_max - origin) / direction;
+            return {vmax(glm::min(t1, t2)), vmin(glm::max(t1, t2))};
+        }
+
+        // First sample at or after t that doesn't lie in an empty macro cell, advancing by whole steps.
+        // Samples before cell_exit are known to lie in the non-empty cell found last and need no lookup
+        float skip_empty(glm::vec3 const & origin, glm::vec3 const & inverse_direction, float t, float t_end, float step,
+            float & cell_exit, volume_render_stats & stats) const
+        {
+            if (t < cell_exit)
+                return t;
+
+            glm::vec3 const direction = 1.f / inverse_direction;
+            while (t < t_end)
+            {
+                glm::vec3 const p = origin + t * direction;
+                glm::ivec3 const cell = glm::clamp(glm::ivec3(glm::floor((p - settings.bbox_min) * inverse_macro_cell_extent)),
+                    glm::ivec3(0), glm::ivec3(volume.macro_size[0], volume.macro_size[1], volume.macro_size[2]) - 1);
+
+                glm::vec3 const cell_min = settings.bbox_min + glm::vec3(cell) * macro_cell_extent;
+                glm::vec3 const t1 = (cell_min - origin) * inverse_direction;
+                glm::vec3 const t2 = (cell_min + macro_cell_extent - origin) * inverse_direction;
+                float const t_exit = vmin(glm::max(t1, t2));
+
+                if (volume.cell(cell.x, cell.y, cell.z).max > 0)
+                {
+                    cell_exit = t_exit;
+                    break;
+                }
+
+                t += std::max(std::ceil((t_exit - t) / step), 1.f) * step;
+                ++stats.skipped_cells;
+            }
+
+            return t;
+        }
+
+        // Trilinear fetch of one level with clamp-to-edge addressing at texture coordinates u, v, w;
+        // lanes outside the mask read zero
+        float8 sample(int level, float8 u, float8 v, float8 w, unsigned int mask) const
+        {
+            auto const & size = volume.level_sizes[level];
+            std::uint8_t const * density = volume.levels[level].data();
+
+            float8 const x = u * float(size[0]) - 0.5f;
+            float8 const y = v * float(size[1]) - 0.5f;
+            float8 const z = w * float(size[2]) - 0.5f;
+            float8 const x0 = floor(x), y0 = floor(y), z0 = floor(z);
+
+            alignas(32) float xi[packet_size], yi[packet_size], zi[packet_size];
+            x0.store(xi);
+            y0.store(yi);
+            z0.store(zi);
+
+            // Corner c of lane i is corners[c][i], with bit 0 of c selecting x + 1, bit 1 y + 1 and bit 2 z + 1
+            alignas(32) float corners[8][packet_size] = {};
+            for (; mask; mask &= mask - 1)
+            {
+                int const i = std::countr_zero(mask);
+
+                int const cx[2] = {std::clamp(int(xi[i]), 0, size[0] - 1), std::clamp(int(xi[i]) + 1, 0, size[0] - 1)};
+                int const cy[2] = {std::clamp(int(yi[i]), 0, size[1] - 1), std::clamp(int(yi[i]) + 1, 0, size[1] - 1)};
+                int const cz[2] = {std::clamp(int(zi[i]), 0, size[2] - 1), std::clamp(int(zi[i]) + 1, 0, size[2] - 1)};
+
+                for (int c = 0; c < 8; ++c)
+                    corners[c][i] = density[cx[c & 1] + size[0] * (cy[(c >> 1) & 1] + size[1] * cz[c >> 2])];
+            }
+
+            float8 const fx = x - x0, fy = y - y0, fz = z - z0;
+            auto lerp = [](float8 a, float8 b, float8 t){ return a + (b - a) * t; };
+            auto corner = [&](int c){ return float8::load(corners[c]); };
+
+            float8 const c00 = lerp(corner(0), corner(1), fx);
+            float8 const c10 = lerp(corner(2), corner(3), fx);
+            float8 const c01 = lerp(corner(4), corner(5), fx);
+            float8 const c11 = lerp(corner(6), corner(7), fx);
+
+            return lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), fz) * (1.f / 255.f);
+        }
+
+        // Linear blend of the two levels around lod, as GL_LINEAR_MIPMAP_LINEAR with textureLod
+        float8 sample_lod(float lod, float8 u, float8 v, float8 w, unsigned int mask) const
+        {
+            int const last = volume.levels.size() - 1;
+            lod = std::clamp(lod, 0.f, float(last));
+
+            int const level = std::min<int>(lod, last);
+            float const blend = lod - level;
+
+            float8 result = sample(level, u, v, w, mask);
+            if (blend > 0.f)
+                result = result + (sample(level + 1, u, v, w, mask) - result) * blend;
+            return result;
+        }
+
+        // Extinction integrated from each masked position to the box exit toward the light
+        float8 light_optical_depth(float const * px, float const * py, float const * pz, unsigned int mask, volume_render_stats & stats) const
+        {
+            glm::vec3 const & direction = settings.light_direction;
+            float const step = 2.f * settings.step_size;
+
+            // Light rays start at samples with density, mostly inside the cloud, so skipping empty cells along
+            // them saves under 1% of their samples and costs more in cell lookups than it saves
+            float t_end[packet_size];
+            for (int i = 0; i < packet_size; ++i)
+                t_end[i] = (mask >> i & 1) ? intersect_bbox({px[i], py[i], pz[i]}, direction).y : -std::numeric_limits<float>::infinity();
+
+            float8 density = 0.f;
+            for (float t = 0.5f * step;; t += step)
+            {
+                unsigned int active = 0;
+                for (int i = 0; i < packet_size; ++i)
+                    if (t < t_end[i])
+                        active |= 1u << i;
+
+                if (!active)
+                    break;
+
+                float8 const u = (float8::load(px) + t * direction.x - settings.bbox_min.x) * (1.f / bbox_size.x);
+                float8 const v = (float8::load(py) + t * direction.y - settings.bbox_min.y) * (1.f / bbox_size.y);
+                float8 const w = (float8::load(pz) + t * direction.z - settings.bbox_min.z) * (1.f / bbox_size.z);
+
+                density = density + sample_lod(settings.light_lod, u, v, w, active);
+                stats.light_samples += std::popcount(active);
+            }
+
+            return density * (extinction * step);
+        }
+
+        // Marches the packet of rays from origin along the directions, returning the scattered radiance
+        // and the transmittance of every lane; lanes with t_end below t_start are left empty
+        void march(glm::vec3 const & origin, float const * dx, float const * dy, float const * dz,
+            float const * t_start, float const * t_end, float * radiance, float * transmittance, volume_render_stats & stats) const
+        {
+            float const step = settings.step_size;
+
+            // Without skipping, every lane is known to be in a non-empty cell up to its end
+            alignas(32) float t[packet_size];
+            float cell_exit[packet_size];
+            glm::vec3 inverse_direction[packet_size];
+            for (int i = 0; i < packet_size; ++i)
+            {
+                t[i] = t_start[i] + 0.5f * step;
+                cell_exit[i] = settings.skip_empty ? -std::numeric_limits<float>::infinity() : t_end[i];
+                inverse_direction[i] = 1.f / glm::vec3(dx[i], dy[i], dz[i]);
+            }
+
+            float8 optical_depth = 0.f;
+            float8 color = 0.f;
+
+            while (true)
+            {
+                unsigned int active = 0;
+                for (int i = 0; i < packet_size; ++i)
+                {
+                    if (t[i] < t_end[i])
+                        t[i] = skip_empty(origin, inverse_direction[i], t[i], t_end[i], step, cell_exit[i], stats);
+                    if (t[i] < t_end[i])
+                        active |= 1u << i;
+                }
+
+                if (!active)
+                    break;
+
+                float8 const s = float8::load(t);
+                alignas(32) float px[packet_size], py[packet_size], pz[packet_size];
+                (s * float8::load(dx) + origin.x).store(px);
+                (s * float8::load(dy) + origin.y).store(py);
+                (s * float8::load(dz) + origin.z).store(pz);
+
+                float8 const u = (float8::load(px) - settings.bbox_min.x) * (1.f / bbox_size.x);
+                float8 const v = (float8::load(py) - settings.bbox_min.y) * (1.f / bbox_size.y);
+                float8 const w = (float8::load(pz) - settings.bbox_min.z) * (1.f / bbox_size.z);
+
+                float8 const density = sample(0, u, v, w, active);
+                stats.samples += std::popcount(active);
+
+                optical_depth = optical_depth + density * (extinction * step);
+
+                // Lanes without density contribute nothing, whatever their light transmittance
+                float8 light_transmittance = 1.f;
+                if (unsigned int const lit = positive_mask(density))
+                    light_transmittance = exp(float8(0.f) - light_optical_depth(px, py, pz, lit, stats));
+
+                color = color + light_transmittance * exp(float8(0.f) - optical_depth) * density
+                    * (light_intensity * step * scattering / (4.f * glm::pi<float>()));
+
+                (s + step).store(t);
+            }
+
+            color.store(radiance);
+            exp(float8(0.f) - optical_depth).store(transmittance);
+        }
+    };
+
+    std::uint8_t to_unorm8(float x)
+    {
+        return std::round(std::clamp(x, 0.f, 1.f) * 255.f);
+    }
+
+}
+
+volume_render_stats render_volume(thread_pool & pool, volume_data const & volume, volume_render_settings const & settings,
+    glm::mat4 const & view, glm::mat4 const & projection, int width, int height, std::uint32_t * pixels)
+{
+    glm::vec3 const volume_size(volume.size()[0], volume.size()[1], volume.size()[2]);
+    glm::vec3 const bbox_size = settings.bbox_max - settings.bbox_min;
+    glm::vec3 const macro_cell_extent = bbox_size * float(volume.macro_cell_size) / volume_size;
+    renderer const r{volume, settings, bbox_size, macro_cell_extent, 1.f / macro_cell_extent};
+
+    // Macro cells built for a lower level than light rays sample can't tell their density is zero
+    if (settings.skip_empty && std::ceil(settings.light_lod) > volume.macro_lod)
+        throw std::runtime_error("The macro cells don't account for light rays sampling level " + std::to_string(settings.light_lod));
+
+    glm::mat4 const inverse_view_projection = glm::inverse(projection * view);
+    glm::vec3 const camera_position(glm::inverse(view)[3]);
+
+    int const tiles_x = (width + tile_size - 1) / tile_size;
+    int const tiles_y = (height + tile_size - 1) / tile_size;
+
+    // Per-worker totals, added to once per tile
+    std::vector<volume_render_stats> worker_stats(pool.thread_count());
+
+    pool.parallel_for(tiles_x * tiles_y, 1, [&](std::size_t begin, std::size_t end, unsigned int worker)
+    {
+        volume_render_stats stats;
+
+        for (std::size_t tile = begin; tile < end; ++tile)
+        {
+            int const x_begin = (tile % tiles_x) * tile_size;
+            int const y_begin = (tile / tiles_x) * tile_size;
+            int const x_end = std::min(x_begin + tile_size, width);
+            int const y_end = std::min(y_begin + tile_size, height);
+
+            for (int y = y_begin; y < y_end; ++y)
+            {
+                for (int x = x_begin; x < x_end; x += packet_size)
+                {
+                    alignas(32) float dx[packet_size], dy[packet_size], dz[packet_size];
+                    float t_start[packet_size], t_end[packet_size];
+
+                    for (int i = 0; i < packet_size; ++i)
+                    {
+                        // Rays through pixel centers; pixels past the edge get an empty range
+                        glm::vec4 far = inverse_view_projection * glm::vec4(2.f * (x + i + 0.5f) / width - 1.f, 2.f * (y + 0.5f) / height - 1.f, 1.f, 1.f);
+                        glm::vec3 const direction = glm::normalize(glm::vec3(far) / far.w - camera_position);
+                        dx[i] = direction.x;
+                        dy[i] = direction.y;
+                        dz[i] = direction.z;
+
+                        glm::vec2 const t = r.intersect_bbox(camera_position, direction);
+                        t_start[i] = std::max(t.x, 0.f);
+                        t_end[i] = (x + i < x_end) ? t.y : -std::numeric_limits<float>::infinity();
+                    }
+
+                    alignas(32) float radiance[packet_size], transmittance[packet_size];
+                    r.march(camera_position, dx, dy, dz, t_start, t_end, radiance, transmittance, stats);
+
+                    for (int i = 0; i < packet_size && x + i < x_end; ++i)
+                    {
+                        glm::vec3 const color = glm::vec3(radiance[i]) + transmittance[i] * settings.background;
+                        pixels[y * width + x + i] = to_unorm8(color.r) | (to_unorm8(color.g) << 8) | (to_unorm8(color.b) << 16) | (0xffu << 24);
+                    }
+                }
+            }
+        }
+
+        worker_stats[worker].samples += stats.samples;
+        worker_stats[worker].light_samples += stats.light_samples;
+        worker_stats[worker].skipped_cells += stats.skipped_cells;
+    });
+
+    volume_render_stats result;
+    for (auto const & s : worker_stats)
+    {
+        result.samples += s.samples;
+        result.light_samples += s.light_samples;
+        result.skipped_cells += s.skipped_cells;
+    }
+    return result;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "volume.hpp"
+#include "thread_pool.hpp"
+
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+// Parameters of the raymarcher in main.cpp, with the same defaults
+struct volume_render_settings
+{
+    glm::vec3 bbox_min{-2.f, -1.f, -1.f};
+    glm::vec3 bbox_max{ 2.f,  1.f,  1.f};
+    glm::vec3 light_direction{0.70710678f, 0.70710678f, 0.f};
+    float step_size = 0.02f;
+    // Density level sampled by light rays, which take twice as long steps
+    float light_lod = 1.f;
+    bool skip_empty = true;
+    glm::vec3 background{0.8f, 0.8f, 0.9f};
+};
+
+struct volume_render_stats
+{
+    // Density samples taken along camera and light rays, and empty macro cells camera rays jumped over
+    std::uint64_t samples = 0;
+    std::uint64_t light_samples = 0;
+    std::uint64_t skipped_cells = 0;
+};
+
+// CPU reference of the shader in main.cpp: absorption and single scattering toward the light, composited
+// over the background. Image tiles are spread over the pool and marched in packets of 8 horizontally
+// adjacent rays. Unlike the shader, light rays are only marched from samples with nonzero density, and
+// empty cells are only skipped along camera rays, neither of which changes the image. Skipping needs
+// the macro cells built for a level at least as high as light_lod; pixels are RGBA8, bottom row first,
+// as image_writer expects
+volume_render_stats render_volume(thread_pool & pool, volume_data const & volume, volume_render_settings const & settings,
+    glm::mat4 const & view, glm::mat4 const & projection, int width, int height, std::uint32_t * pixels);
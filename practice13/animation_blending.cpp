@@ -0,0 +1,158 @@
+#include "animation_blending.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+
+    float loop_time(gltf_model::animation const & clip, float time)
+    {
+        return (clip.max_time > 0.f) ? std::fmod(time, clip.max_time) : 0.f;
+    }
+
+    // Normalized lerp through the shorter arc
+    glm::quat nlerp(glm::quat const & a, glm::quat const & b, float t)
+    {
+        float const sign = std::copysign(1.f, glm::dot(a, b));
+        glm::quat const r(
+            a.w + (sign * b.w - a.w) * t,
+            a.x + (sign * b.x - a.x) * t,
+            a.y + (sign * b.y - a.y) * t,
+            a.z + (sign * b.z - a.z) * t);
+        return r * (1.f / std::sqrt(glm::dot(r, r)));
+    }
+
+}
+
+pose_pool::pose_pool(std::size_t bone_count, std::size_t capacity)
+    : bones(bone_count)
+    , storage(bone_count * capacity)
+{
+    free_list.reserve(capacity);
+    for (std::size_t i = capacity; i-- > 0;)
+        free_list.push_back(storage.data() + i * bone_count);
+}
+
+bone_pose * pose_pool::acquire()
+{
+    if (free_list.empty())
+        throw std::runtime_error("Pose pool exhausted");
+
+    auto result = free_list.back();
+    free_list.pop_back();
+    return result;
+}
+
+void pose_pool::release(bone_pose * pose)
+{
+    assert(pose >= storage.data() && pose < storage.data() + storage.size());
+    assert(free_list.size() < free_list.capacity());
+    free_list.push_back(pose);
+}
+
+unsigned int find_bone(std::vector<gltf_model::bone> const & bones, std::string const & name)
+{
+    for (unsigned int i = 0; i < bones.size(); ++i)
+        if (bones[i].name == name)
+            return i;
+    throw std::runtime_error("Unknown bone: " + name);
+}
+
+void fill_bone_mask(std::vector<gltf_model::bone> const & bones, unsigned int root, float weight, float * mask)
+{
+    // Parents precede children, so a single pass after the root finds the whole subtree
+    std::vector<bool> inside(bones.size(), false);
+    inside[root] = true;
+    mask[root] = weight;
+
+    for (unsigned int i = root + 1; i < bones.size(); ++i)
+    {
+        if (bones[i].parent != -1 && inside[bones[i].parent])
+        {
+            inside[i] = true;
+            mask[i] = weight;
+        }
+    }
+}
+
+void blend_poses(bone_pose const * a, bone_pose const * b, float weight, float const * mask, std::size_t count, bone_pose * result)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        float const t = mask ? weight * mask[i] : weight;
+        result[i].translation = glm::lerp(a[i].translation, b[i].translation, t);
+        result[i].rotation = nlerp(a[i].rotation, b[i].rotation, t);
+        result[i].scale = glm::lerp(a[i].scale, b[i].scale, t);
+    }
+}
+
+void make_additive_pose(bone_pose const * pose, bone_pose const * reference, std::size_t count, bone_pose * result)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        result[i].translation = pose[i].translation - reference[i].translation;
+        result[i].rotation = pose[i].rotation * glm::inverse(reference[i].rotation);
+        result[i].scale = pose[i].scale / reference[i].scale;
+    }
+}
+
+void add_pose(bone_pose const * base, bone_pose const * additive, float weight, float const * mask, std::size_t count, bone_pose * result)
+{
+    glm::quat const identity(1.f, 0.f, 0.f, 0.f);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        float const t = mask ? weight * mask[i] : weight;
+        result[i].translation = base[i].translation + additive[i].translation * t;
+        result[i].rotation = nlerp(identity, additive[i].rotation, t) * base[i].rotation;
+        result[i].scale = base[i].scale * glm::lerp(glm::vec3(1.f), additive[i].scale, t);
+    }
+}
+
+void animation_player::play(gltf_model::animation const & clip, float fade)
+{
+    if (current && fade > 0.f)
+    {
+        previous = current;
+        previous_time = current_time;
+        fade_elapsed = 0.f;
+        fade_duration = fade;
+    }
+    else
+    {
+        previous = nullptr;
+        fade_duration = 0.f;
+    }
+
+    current = &clip;
+    current_time = 0.f;
+}
+
+void animation_player::update(float dt)
+{
+    if (current)
+        current_time = loop_time(*current, current_time + dt);
+
+    if (previous)
+    {
+        previous_time = loop_time(*previous, previous_time + dt);
+        fade_elapsed += dt;
+        if (fade_elapsed >= fade_duration)
+            previous = nullptr;
+    }
+}
+
+void animation_player::sample(pose_pool & pool, bone_pose * result) const
+{
+    assert(current);
+
+    sample_animation(*current, current_time, result);
+
+    if (previous)
+    {
+        pooled_pose from(pool);
+        sample_animation(*previous, previous_time, from.data());
+        blend_poses(from.data(), result, fade_elapsed / fade_duration, nullptr, pool.bone_count(), result);
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "skinning.hpp"
+
+// Fixed number of bone_count-sized pose buffers allocated up front
+struct pose_pool
+{
+    pose_pool(std::size_t bone_count, std::size_t capacity);
+
+    pose_pool(pose_pool const &) = delete;
+    pose_pool & operator = (pose_pool const &) = delete;
+
+    std::size_t bone_count() const
+    {
+        return bones;
+    }
+
+    std::size_t available() const
+    {
+        return free_list.size();
+    }
+
+    // Throws if the pool is exhausted
+    bone_pose * acquire();
+    void release(bone_pose * pose);
+
+private:
+    std::size_t bones;
+    aligned_vector<bone_pose> storage;
+    std::vector<bone_pose *> free_list;
+};
+
+// Returns the buffer to its pool when going out of scope
+struct pooled_pose
+{
+    explicit pooled_pose(pose_pool & pool)
+        : pool(&pool)
+        , pose(pool.acquire())
+    {}
+
+    ~pooled_pose()
+    {
+        pool->release(pose);
+    }
+
+    pooled_pose(pooled_pose const &) = delete;
+    pooled_pose & operator = (pooled_pose const &) = delete;
+
+    bone_pose * data() const
+    {
+        return pose;
+    }
+
+private:
+    pose_pool * pool;
+    bone_pose * pose;
+};
+
+unsigned int find_bone(std::vector<gltf_model::bone> const & bones, std::string const & name);
+
+// Sets mask[i] = weight for the root bone and all its descendants
+void fill_bone_mask(std::vector<gltf_model::bone> const & bones, unsigned int root, float weight, float * mask);
+
+// result = lerp(a, b, weight * mask[i]); mask may be null, result may alias a or b
+void blend_poses(bone_pose const * a, bone_pose const * b, float weight, float const * mask, std::size_t count, bone_pose * result);
+
+// Difference of pose from reference, to be applied by add_pose
+void make_additive_pose(bone_pose const * pose, bone_pose const * reference, std::size_t count, bone_pose * result);
+
+// Applies an additive pose on top of base with weight * mask[i]; mask may be null, result may alias base
+void add_pose(bone_pose const * base, bone_pose const * additive, float weight, float const * mask, std::size_t count, bone_pose * result);
+
+// Plays one clip at a time, crossfading from the previous one when switching
+struct animation_player
+{
+    gltf_model::animation const * current = nullptr;
+    gltf_model::animation const * previous = nullptr;
+
+    float current_time = 0.f;
+    float previous_time = 0.f;
+
+    float fade_elapsed = 0.f;
+    float fade_duration = 0.f;
+
+    // Calling play during a crossfade drops the clip being faded out: the new fade starts from the
+    // current clip alone, so the pose jumps by whatever the older clip still contributed
+    void play(gltf_model::animation const & clip, float fade = 0.f);
+    void update(float dt);
+
+    // Uses one temporary buffer from the pool while a crossfade is in progress
+    void sample(pose_pool & pool, bone_pose * result) const;
+};
@@ -0,0 +1,522 @@
+#include "animation_compression.hpp"
+
+#include <cmath>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+
+    constexpr float sqrt2 = 1.41421356f;
+    constexpr std::uint16_t max_packed = 0x7fff;
+
+    constexpr char magic[4] = {'A', 'N', 'I', 'M'};
+    constexpr std::uint32_t version = 1;
+
+    template <typename T, typename Packed>
+    std::size_t track_size(compressed_animation::track<T, Packed> const & track)
+    {
+        return track.timestamps.size() * sizeof(float) + track.values.size() * sizeof(Packed);
+    }
+
+    template <typename T>
+    std::size_t track_size(gltf_model::spline<T> const & spline)
+    {
+        return spline.timestamps.size() * sizeof(float)
+            + (spline.values.size() + spline.in_tangents.size() + spline.out_tangents.size()) * sizeof(T);
+    }
+
+    // Resamples step and cubic splines into linear keys that the reduction can work on
+    template <typename T>
+    gltf_model::spline<T> linearize(gltf_model::spline<T> const & spline, float sample_rate)
+    {
+        gltf_model::spline<T> result;
+
+        for (std::size_t i = 0; i < spline.values.size(); ++i)
+        {
+            result.timestamps.push_back(spline.timestamps[i]);
+            result.values.push_back(spline.values[i]);
+
+            if (i + 1 == spline.values.size())
+                break;
+
+            float const begin = spline.timestamps[i];
+            float const duration = spline.timestamps[i + 1] - begin;
+
+            if (spline.interpolation == gltf_model::interpolation_mode::step)
+            {
+                result.timestamps.push_back(begin + duration * 0.999f);
+                result.values.push_back(spline.values[i]);
+                continue;
+            }
+
+            int const steps = std::max(1, static_cast<int>(std::ceil(duration * sample_rate)));
+            for (int k = 1; k < steps; ++k)
+            {
+                float const time = begin + duration * k / steps;
+                result.timestamps.push_back(time);
+                result.values.push_back(spline(time));
+            }
+        }
+
+        return result;
+    }
+
+    glm::vec3 encode_key(glm::vec3 const & value)
+    {
+        return value;
+    }
+
+    packed_quat encode_key(glm::quat const & value)
+    {
+        return pack_quat(value);
+    }
+
+    float rotation_angle(glm::quat const & a, glm::quat const & b)
+    {
+        float const d = std::min(1.f, std::abs(glm::dot(a, b)));
+        return 2.f * std::acos(d);
+    }
+
+    // Greedily extends every segment while linear interpolation between its decoded
+    // end keys reproduces all skipped original keys within the tolerance
+    template <typename T, typename Packed, typename Error>
+    void reduce_track(gltf_model::spline<T> const & spline, float sample_rate, compressed_animation::track<T, Packed> & result, Error const & error)
+    {
+        if (spline.interpolation != gltf_model::interpolation_mode::linear)
+            return reduce_track(linearize(spline, sample_rate), sample_rate, result, error);
+
+        std::size_t const count = spline.values.size();
+        if (count == 0)
+            return;
+
+        std::vector<Packed> encoded;
+        std::vector<T> decoded;
+        encoded.reserve(count);
+        decoded.reserve(count);
+        for (auto const & value : spline.values)
+        {
+            encoded.push_back(encode_key(value));
+            decoded.push_back(decode_key<T, Packed>(encoded.back()));
+        }
+
+        auto keep = [&](std::size_t i)
+        {
+            result.timestamps.push_back(spline.timestamps[i]);
+            result.values.push_back(encoded[i]);
+        };
+
+        bool constant = true;
+        for (std::size_t i = 1; i < count && constant; ++i)
+            constant = error(decoded[0], spline.values[i]);
+
+        if (constant)
+        {
+            keep(0);
+            return;
+        }
+
+        auto segment_fits = [&](std::size_t begin, std::size_t end)
+        {
+            float const duration = spline.timestamps[end] - spline.timestamps[begin];
+            for (std::size_t i = begin + 1; i < end; ++i)
+            {
+                float const t = (spline.timestamps[i] - spline.timestamps[begin]) / duration;
+                if (!error(interpolate(decoded[begin], decoded[end], t), spline.values[i]))
+                    return false;
+            }
+            return true;
+        };
+
+        keep(0);
+
+        std::size_t begin = 0;
+        while (begin + 1 < count)
+        {
+            std::size_t end = begin + 1;
+            while (end + 1 < count && segment_fits(begin, end + 1))
+                ++end;
+
+            keep(end);
+            begin = end;
+        }
+    }
+
+    struct bone_lever
+    {
+        // Largest distance from the bone to its descendants plus the skin margin, which turns rotation and
+        // scale errors into displacements
+        float reach = 0.f;
+        // Scale of the parent's space, which turns translation errors into displacements
+        float parent_scale = 1.f;
+        // Number of bones on the longest root-to-leaf chain through the bone, whose errors may add up
+        int chain = 1;
+    };
+
+    // Measured in the first frame of the animation
+    std::vector<bone_lever> bone_levers(std::vector<gltf_model::bone> const & bones, gltf_model::animation const & animation, float skin_margin)
+    {
+        std::vector<bone_pose> pose(bones.size());
+        aligned_vector<glm::mat4> global(bones.size());
+        aligned_vector<glm::mat4> palette(bones.size());
+
+        sample_animation(animation, 0.f, pose.data());
+        compute_bone_palette(bones, pose.data(), global.data(), palette.data());
+
+        std::vector<bone_lever> levers(bones.size());
+        for (std::size_t i = 0; i < bones.size(); ++i)
+        {
+            glm::vec3 const position(global[i][3]);
+            for (auto parent = bones[i].parent; parent != -1; parent = bones[parent].parent)
+                levers[parent].reach = std::max(levers[parent].reach, glm::distance(position, glm::vec3(global[parent][3])));
+
+            if (auto const parent = bones[i].parent; parent != -1)
+            {
+                auto const & m = global[parent];
+                levers[i].parent_scale = std::max({glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))});
+            }
+        }
+
+        for (auto & lever : levers)
+            lever.reach += skin_margin;
+
+        // Parents come before their children: depths go forward, heights of the subtrees backward
+        std::vector<int> depth(bones.size(), 1);
+        std::vector<int> height(bones.size(), 1);
+        for (std::size_t i = 0; i < bones.size(); ++i)
+            if (bones[i].parent != -1)
+                depth[i] = depth[bones[i].parent] + 1;
+        for (std::size_t i = bones.size(); i-- > 0;)
+            if (bones[i].parent != -1)
+                height[bones[i].parent] = std::max(height[bones[i].parent], height[i] + 1);
+
+        for (std::size_t i = 0; i < bones.size(); ++i)
+            levers[i].chain = depth[i] + height[i] - 1;
+
+        return levers;
+    }
+
+    template <typename Animation>
+    void sample_joints(std::vector<gltf_model::bone> const & bones, Animation const & animation, float time, float skin_margin,
+        bone_pose * pose, glm::mat4 * global, glm::mat4 * palette, std::vector<glm::vec3> & points)
+    {
+        sample_animation(animation, time, pose);
+        compute_bone_palette(bones, pose, global, palette);
+
+        points.clear();
+        for (std::size_t i = 0; i < bones.size(); ++i)
+        {
+            points.push_back(glm::vec3(global[i] * glm::vec4(0.f, 0.f, 0.f, 1.f)));
+            points.push_back(glm::vec3(global[i] * glm::vec4(skin_margin, 0.f, 0.f, 1.f)));
+            points.push_back(glm::vec3(global[i] * glm::vec4(0.f, skin_margin, 0.f, 1.f)));
+            points.push_back(glm::vec3(global[i] * glm::vec4(0.f, 0.f, skin_margin, 1.f)));
+        }
+    }
+
+    template <typename T>
+    void write_value(std::ostream & output, T const & value)
+    {
+        output.write(reinterpret_cast<char const *>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    void write_array(std::ostream & output, std::vector<T> const & values)
+    {
+        output.write(reinterpret_cast<char const *>(values.data()), values.size() * sizeof(T));
+    }
+
+    template <typename T>
+    T read_value(std::istream & input)
+    {
+        T value;
+        if (!input.read(reinterpret_cast<char *>(&value), sizeof(value)))
+            throw std::runtime_error("Unexpected end of compressed animation data");
+        return value;
+    }
+
+    // Bytes left in the stream, or the largest size if it cannot seek
+    std::size_t remaining_size(std::istream & input)
+    {
+        auto const position = input.tellg();
+        if (position == std::istream::pos_type(-1))
+            return std::numeric_limits<std::size_t>::max();
+
+        input.seekg(0, std::ios::end);
+        auto const end = input.tellg();
+        input.seekg(position);
+        return end - position;
+    }
+
+    // Rejects element counts that the rest of the stream cannot hold before allocating for them
+    void check_count(std::istream & input, std::size_t count, std::size_t element_size)
+    {
+        if (count > remaining_size(input) / element_size)
+            throw std::runtime_error("Corrupt compressed animation data: " + std::to_string(count) + " elements past the end");
+    }
+
+    template <typename T>
+    void read_array(std::istream & input, std::vector<T> & values, std::size_t count)
+    {
+        check_count(input, count, sizeof(T));
+        values.resize(count);
+        if (!input.read(reinterpret_cast<char *>(values.data()), count * sizeof(T)))
+            throw std::runtime_error("Unexpected end of compressed animation data");
+    }
+
+    template <typename T, typename Packed>
+    void write_track(std::ostream & output, compressed_animation::track<T, Packed> const & track)
+    {
+        write_value<std::uint32_t>(output, track.timestamps.size());
+        write_array(output, track.timestamps);
+        write_array(output, track.values);
+    }
+
+    template <typename T, typename Packed>
+    void read_track(std::istream & input, compressed_animation::track<T, Packed> & track)
+    {
+        auto const count = read_value<std::uint32_t>(input);
+        read_array(input, track.timestamps, count);
+        read_array(input, track.values, count);
+    }
+
+}
+
+packed_quat pack_quat(glm::quat const & q)
+{
+    float const components[4] = {q.x, q.y, q.z, q.w};
+
+    int largest = 0;
+    for (int i = 1; i < 4; ++i)
+        if (std::abs(components[i]) > std::abs(components[largest]))
+            largest = i;
+
+    float const sign = (components[largest] < 0.f) ? -1.f : 1.f;
+
+    packed_quat result;
+    for (int i = 0, j = 0; i < 4; ++i)
+    {
+        if (i == largest) continue;
+
+        float const v = glm::clamp(sign * components[i] * sqrt2 * 0.5f + 0.5f, 0.f, 1.f);
+        result.data[j++] = static_cast<std::uint16_t>(std::lround(v * max_packed));
+    }
+
+    result.data[0] |= (largest & 1) << 15;
+    result.data[1] |= (largest >> 1) << 15;
+
+    return result;
+}
+
+glm::quat unpack_quat(packed_quat const & q)
+{
+    int const largest = (q.data[0] >> 15) | ((q.data[1] >> 15) << 1);
+
+    float components[4];
+    float sum = 0.f;
+    for (int i = 0, j = 0; i < 4; ++i)
+    {
+        if (i == largest) continue;
+
+        float const v = ((q.data[j++] & max_packed) * (1.f / max_packed) - 0.5f) * sqrt2;
+        components[i] = v;
+        sum += v * v;
+    }
+    components[largest] = std::sqrt(std::max(0.f, 1.f - sum));
+
+    return glm::quat(components[3], components[0], components[1], components[2]);
+}
+
+std::size_t compressed_animation::memory_size() const
+{
+    std::size_t result = 0;
+    for (auto const & bone : bones)
+    {
+        result += track_size(bone.translation);
+        result += track_size(bone.rotation);
+        result += track_size(bone.scale);
+    }
+    return result;
+}
+
+std::size_t memory_size(gltf_model::animation const & animation)
+{
+    std::size_t result = 0;
+    for (auto const & bone : animation.bones)
+    {
+        result += track_size(bone.translation);
+        result += track_size(bone.rotation);
+        result += track_size(bone.scale);
+    }
+    return result;
+}
+
+compressed_animation compress_animation(std::vector<gltf_model::bone> const & bones, gltf_model::animation const & animation,
+    animation_compression_settings const & settings, animation_compression_stats * stats)
+{
+    assert(animation.bones.size() == bones.size());
+
+    auto const levers = bone_levers(bones, animation, settings.skin_margin);
+
+    auto compress = [&](float tolerance)
+    {
+        compressed_animation result;
+        result.max_time = animation.max_time;
+        result.bones.resize(animation.bones.size());
+
+        for (std::size_t i = 0; i < animation.bones.size(); ++i)
+        {
+            auto const & source = animation.bones[i];
+            auto & target = result.bones[i];
+
+            // Every bone of a chain gets an equal share, so that the errors along it add up to at most the tolerance
+            float const budget = tolerance / levers[i].chain;
+            float const lever = levers[i].reach;
+            float const parent_scale = levers[i].parent_scale;
+
+            reduce_track(source.translation, settings.error_sample_rate, target.translation, [&](glm::vec3 const & a, glm::vec3 const & b){
+                return glm::distance(a, b) * parent_scale <= budget;
+            });
+
+            reduce_track(source.rotation, settings.error_sample_rate, target.rotation, [&](glm::quat const & a, glm::quat const & b){
+                return rotation_angle(a, b) * lever <= budget;
+            });
+
+            reduce_track(source.scale, settings.error_sample_rate, target.scale, [&](glm::vec3 const & a, glm::vec3 const & b){
+                return glm::distance(a, b) * lever <= budget;
+            });
+        }
+
+        return result;
+    };
+
+    std::vector<bone_pose> pose(bones.size());
+    aligned_vector<glm::mat4> global(bones.size());
+    aligned_vector<glm::mat4> palette(bones.size());
+    std::vector<glm::vec3> original_points;
+    std::vector<glm::vec3> compressed_points;
+
+    auto measure_error = [&](compressed_animation const & compressed)
+    {
+        float error = 0.f;
+
+        int const samples = std::max(1, static_cast<int>(std::ceil(animation.max_time * settings.error_sample_rate)));
+        for (int s = 0; s <= samples; ++s)
+        {
+            float const time = animation.max_time * s / samples;
+
+            sample_joints(bones, animation, time, settings.skin_margin, pose.data(), global.data(), palette.data(), original_points);
+            sample_joints(bones, compressed, time, settings.skin_margin, pose.data(), global.data(), palette.data(), compressed_points);
+
+            for (std::size_t i = 0; i < original_points.size(); ++i)
+                error = std::max(error, glm::distance(original_points[i], compressed_points[i]));
+        }
+
+        return error;
+    };
+
+    // The per-track bounds are linear estimates, so tighten them until the measured error fits;
+    // the last attempt keeps every key and only quantization error remains
+    int const attempts = 8;
+    float tolerance = settings.tolerance;
+    compressed_animation result;
+    float error = 0.f;
+    for (int attempt = 0; attempt < attempts; ++attempt)
+    {
+        result = compress(attempt + 1 < attempts ? tolerance : 0.f);
+        error = measure_error(result);
+        if (error <= settings.tolerance)
+            break;
+        tolerance *= 0.5f;
+    }
+
+    if (stats)
+    {
+        stats->original_size = memory_size(animation);
+        stats->compressed_size = result.memory_size();
+        stats->max_error = error;
+    }
+
+    return result;
+}
+
+void sample_animation(compressed_animation const & animation, float time, bone_pose * pose)
+{
+    for (std::size_t i = 0; i < animation.bones.size(); ++i)
+    {
+        auto const & bone = animation.bones[i];
+        pose[i].translation = bone.translation.values.empty() ? glm::vec3(0.f) : bone.translation(time);
+        pose[i].rotation = bone.rotation.values.empty() ? glm::quat(1.f, 0.f, 0.f, 0.f) : bone.rotation(time);
+        pose[i].scale = bone.scale.values.empty() ? glm::vec3(1.f) : bone.scale(time);
+    }
+}
+
+gltf_model::animation decompress_animation(compressed_animation const & animation)
+{
+    auto decode = [](auto const & track, auto & spline)
+    {
+        using value_type = std::decay_t<decltype(spline.values[0])>;
+
+        spline.timestamps = track.timestamps;
+        spline.values.reserve(track.values.size());
+        for (auto const & value : track.values)
+            spline.values.push_back(decode_key<value_type>(value));
+    };
+
+    gltf_model::animation result;
+    result.max_time = animation.max_time;
+    result.bones.resize(animation.bones.size());
+
+    for (std::size_t i = 0; i < animation.bones.size(); ++i)
+    {
+        decode(animation.bones[i].translation, result.bones[i].translation);
+        decode(animation.bones[i].rotation, result.bones[i].rotation);
+        decode(animation.bones[i].scale, result.bones[i].scale);
+    }
+
+    return result;
+}
+
+void write_compressed_animation(std::ostream & output, compressed_animation const & animation)
+{
+    output.write(magic, sizeof(magic));
+    write_value<std::uint32_t>(output, version);
+    write_value<std::uint32_t>(output, animation.bones.size());
+    write_value<float>(output, animation.max_time);
+
+    for (auto const & bone : animation.bones)
+    {
+        write_track(output, bone.translation);
+        write_track(output, bone.rotation);
+        write_track(output, bone.scale);
+    }
+}
+
+compressed_animation read_compressed_animation(std::istream & input)
+{
+    char header[4];
+    if (!input.read(header, sizeof(header)) || !std::equal(header, header + 4, magic))
+        throw std::runtime_error("Not a compressed animation");
+
+    if (auto const file_version = read_value<std::uint32_t>(input); file_version != version)
+        throw std::runtime_error("Unsupported compressed animation version: " + std::to_string(file_version));
+
+    auto const bone_count = read_value<std::uint32_t>(input);
+    // Every bone stores at least the key counts of its three tracks
+    check_count(input, bone_count, 3 * sizeof(std::uint32_t));
+
+    compressed_animation result;
+    result.bones.resize(bone_count);
+    result.max_time = read_value<float>(input);
+
+    for (auto & bone : result.bones)
+    {
+        read_track(input, bone.translation);
+        read_track(input, bone.rotation);
+        read_track(input, bone.scale);
+    }
+
+    return result;
+}
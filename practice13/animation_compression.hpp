@@ -0,0 +1,102 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "skinning.hpp"
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+
+// Smallest-three encoding: the three smallest components with 15 bits each,
+// the index of the dropped largest one is kept in the top bits of data[0] and data[1]
+struct packed_quat
+{
+    std::array<std::uint16_t, 3> data;
+};
+
+packed_quat pack_quat(glm::quat const & q);
+glm::quat unpack_quat(packed_quat const & q);
+
+struct compressed_animation
+{
+    template <typename T, typename Packed>
+    struct track
+    {
+        std::vector<float> timestamps;
+        std::vector<Packed> values;
+
+        T operator()(float time) const;
+    };
+
+    struct bone_animation
+    {
+        track<glm::vec3, glm::vec3> translation;
+        track<glm::quat, packed_quat> rotation;
+        track<glm::vec3, glm::vec3> scale;
+    };
+
+    std::vector<bone_animation> bones;
+    float max_time = 0.f;
+
+    std::size_t memory_size() const;
+};
+
+struct animation_compression_settings
+{
+    // Maximum allowed displacement of a joint or of the skin around it, in skinned space units, as measured
+    // at error_sample_rate. It is split evenly between the bones of each chain, and the split is tightened
+    // until the measured error fits; only quantization error can remain above it
+    float tolerance = 0.1f;
+    // Distance from a joint to the skin it drives, added to every bone's reach
+    float skin_margin = 10.f;
+    // Rate at which max_error is measured and step or cubic tracks are resampled
+    float error_sample_rate = 120.f;
+};
+
+struct animation_compression_stats
+{
+    std::size_t original_size = 0;
+    std::size_t compressed_size = 0;
+    float max_error = 0.f;
+};
+
+std::size_t memory_size(gltf_model::animation const & animation);
+
+compressed_animation compress_animation(std::vector<gltf_model::bone> const & bones, gltf_model::animation const & animation,
+    animation_compression_settings const & settings = {}, animation_compression_stats * stats = nullptr);
+
+void sample_animation(compressed_animation const & animation, float time, bone_pose * pose);
+
+// Decodes all keys once, e.g. to share one decoded clip among many instances
+gltf_model::animation decompress_animation(compressed_animation const & animation);
+
+void write_compressed_animation(std::ostream & output, compressed_animation const & animation);
+compressed_animation read_compressed_animation(std::istream & input);
+
+template <typename T, typename Packed>
+T decode_key(Packed const & value);
+
+template <>
+inline glm::vec3 decode_key<glm::vec3, glm::vec3>(glm::vec3 const & value)
+{
+    return value;
+}
+
+template <>
+inline glm::quat decode_key<glm::quat, packed_quat>(packed_quat const & value)
+{
+    return unpack_quat(value);
+}
+
+template <typename T, typename Packed>
+T compressed_animation::track<T, Packed>::operator()(float time) const
+{
+    assert(values.size() == timestamps.size());
+
+    auto key = [this](std::size_t i)
+    {
+        return decode_key<T, Packed>(values[i]);
+    };
+
+    return sample_keys<T>(timestamps, time, gltf_model::interpolation_mode::linear, key);
+}
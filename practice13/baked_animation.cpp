@@ -0,0 +1,188 @@
+#include "baked_animation.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+
+    constexpr char magic[4] = {'B', 'A', 'K', 'E'};
+    constexpr std::uint32_t version = 1;
+
+    struct frame_position
+    {
+        std::size_t frame;
+        float t;
+    };
+
+    frame_position locate(baked_animation const & animation, float time)
+    {
+        if (animation.frame_count < 2 || animation.duration <= 0.f)
+            return {0, 0.f};
+
+        float const frame = std::fmod(time, animation.duration) / animation.frame_interval();
+        std::size_t const index = std::min<std::size_t>(static_cast<std::size_t>(frame), animation.frame_count - 2);
+        return {index, std::min(frame - index, 1.f)};
+    }
+
+    void lerp(float const * a, float const * b, float t, std::size_t count, float * result)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            result[i] = a[i] + (b[i] - a[i]) * t;
+    }
+
+    template <typename T>
+    void write_value(std::ostream & output, T const & value)
+    {
+        output.write(reinterpret_cast<char const *>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    T read_value(std::istream & input)
+    {
+        T value;
+        if (!input.read(reinterpret_cast<char *>(&value), sizeof(value)))
+            throw std::runtime_error("Unexpected end of baked animation data");
+        return value;
+    }
+
+}
+
+baked_animation bake_animation(std::vector<gltf_model::bone> const & bones, gltf_model::animation const & animation,
+    float frame_rate, palette_format format)
+{
+    baked_animation result;
+    result.format = format;
+    result.frame_rate = frame_rate;
+    result.duration = animation.max_time;
+    result.frame_count = static_cast<std::size_t>(std::ceil(animation.max_time * frame_rate)) + 1;
+    result.bone_count = bones.size();
+    result.data.resize(result.frame_count * result.bone_count * result.stride());
+
+    std::vector<bone_pose> pose(bones.size());
+    aligned_vector<glm::mat4> global(bones.size());
+    aligned_vector<glm::mat4> palette(bones.size());
+    std::vector<dual_quaternion> dq_palette(bones.size());
+
+    for (std::size_t f = 0; f < result.frame_count; ++f)
+    {
+        float const time = (f + 1 == result.frame_count) ? animation.max_time : f * result.frame_interval();
+
+        sample_animation(animation, time, pose.data());
+        compute_bone_palette(bones, pose.data(), global.data(), palette.data());
+
+        float * target = result.data.data() + f * result.bone_count * result.stride();
+
+        if (format == palette_format::matrix)
+        {
+            std::memcpy(target, palette.data(), palette.size() * sizeof(glm::mat4));
+            continue;
+        }
+
+        result.scale = compute_dual_quaternion_palette(palette.data(), palette.size(), dq_palette.data());
+
+        // Keep consecutive frames in the same hemisphere so that plain lerp between them is valid
+        if (f > 0)
+        {
+            auto const previous = reinterpret_cast<dual_quaternion const *>(result.frame(f - 1));
+            for (std::size_t i = 0; i < dq_palette.size(); ++i)
+            {
+                if (glm::dot(previous[i].real, dq_palette[i].real) < 0.f)
+                {
+                    dq_palette[i].real = -dq_palette[i].real;
+                    dq_palette[i].dual = -dq_palette[i].dual;
+                }
+            }
+        }
+
+        std::memcpy(target, dq_palette.data(), dq_palette.size() * sizeof(dual_quaternion));
+    }
+
+    return result;
+}
+
+void sample_baked_animation(baked_animation const & animation, float time, glm::mat4 * palette)
+{
+    assert(animation.format == palette_format::matrix);
+
+    auto const [frame, t] = locate(animation, time);
+    std::size_t const next = std::min(frame + 1, animation.frame_count - 1);
+
+    lerp(animation.frame(frame), animation.frame(next), t, animation.bone_count * 16, &palette[0][0][0]);
+}
+
+void sample_baked_animation(baked_animation const & animation, float time, dual_quaternion * palette)
+{
+    assert(animation.format == palette_format::dual_quaternion);
+
+    auto const [frame, t] = locate(animation, time);
+    std::size_t const next = std::min(frame + 1, animation.frame_count - 1);
+
+    lerp(animation.frame(frame), animation.frame(next), t, animation.bone_count * 8, &palette[0].real.w);
+
+    for (std::size_t i = 0; i < animation.bone_count; ++i)
+    {
+        float const inverse_norm = 1.f / glm::length(palette[i].real);
+        palette[i].real = palette[i].real * inverse_norm;
+        palette[i].dual = palette[i].dual * inverse_norm;
+    }
+}
+
+void write_baked_animation(std::ostream & output, baked_animation const & animation)
+{
+    output.write(magic, sizeof(magic));
+    write_value<std::uint32_t>(output, version);
+    write_value<std::uint32_t>(output, static_cast<std::uint32_t>(animation.format));
+    write_value<float>(output, animation.frame_rate);
+    write_value<float>(output, animation.duration);
+    write_value<std::uint32_t>(output, animation.frame_count);
+    write_value<std::uint32_t>(output, animation.bone_count);
+    write_value<float>(output, animation.scale);
+    output.write(reinterpret_cast<char const *>(animation.data.data()), animation.memory_size());
+}
+
+baked_animation read_baked_animation(std::istream & input)
+{
+    char header[4];
+    if (!input.read(header, sizeof(header)) || !std::equal(header, header + 4, magic))
+        throw std::runtime_error("Not a baked animation");
+
+    if (auto const file_version = read_value<std::uint32_t>(input); file_version != version)
+        throw std::runtime_error("Unsupported baked animation version: " + std::to_string(file_version));
+
+    baked_animation result;
+    result.format = static_cast<palette_format>(read_value<std::uint32_t>(input));
+    result.frame_rate = read_value<float>(input);
+    result.duration = read_value<float>(input);
+    result.frame_count = read_value<std::uint32_t>(input);
+    result.bone_count = read_value<std::uint32_t>(input);
+    result.scale = read_value<float>(input);
+
+    if (result.format != palette_format::matrix && result.format != palette_format::dual_quaternion)
+        throw std::runtime_error("Unknown baked animation palette format");
+
+    // Validate the header against the data that follows before allocating for it
+    auto const position = input.tellg();
+    if (position != std::istream::pos_type(-1))
+    {
+        input.seekg(0, std::ios::end);
+        std::size_t const remaining = input.tellg() - position;
+        input.seekg(position);
+
+        std::size_t const row_size = result.bone_count * result.stride() * sizeof(float);
+        if (row_size != 0 && result.frame_count > remaining / row_size)
+            throw std::runtime_error("Baked animation header claims " + std::to_string(result.frame_count) + " frames of "
+                + std::to_string(row_size) + " bytes, but only " + std::to_string(remaining) + " bytes follow");
+    }
+
+    result.data.resize(result.frame_count * result.bone_count * result.stride());
+    if (!input.read(reinterpret_cast<char *>(result.data.data()), result.memory_size()))
+        throw std::runtime_error("Unexpected end of baked animation data");
+
+    return result;
+}
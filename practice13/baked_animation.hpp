@@ -0,0 +1,60 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "skinning.hpp"
+
+#include <iosfwd>
+
+enum class palette_format
+{
+    matrix,
+    dual_quaternion,
+};
+
+// Skinning palettes pre-sampled at evenly spaced times from 0 to duration inclusive, at least frame_rate
+// per second, frame-major: frame f holds bone_count palette entries of 16 (matrix) or 8 (dual quaternion) floats each
+struct baked_animation
+{
+    palette_format format = palette_format::matrix;
+    // Requested rate; frames are frame_interval() apart, which fits a whole number of them into duration
+    float frame_rate = 30.f;
+    float duration = 0.f;
+    std::size_t frame_count = 0;
+    std::size_t bone_count = 0;
+    // Skeleton-wide scale factored out of dual quaternion palettes
+    float scale = 1.f;
+
+    aligned_vector<float> data;
+
+    float frame_interval() const
+    {
+        return (frame_count > 1) ? duration / (frame_count - 1) : 0.f;
+    }
+
+    std::size_t stride() const
+    {
+        return (format == palette_format::matrix) ? 16 : 8;
+    }
+
+    float const * frame(std::size_t index) const
+    {
+        return data.data() + index * bone_count * stride();
+    }
+
+    std::size_t memory_size() const
+    {
+        return data.size() * sizeof(float);
+    }
+};
+
+baked_animation bake_animation(std::vector<gltf_model::bone> const & bones, gltf_model::animation const & animation,
+    float frame_rate, palette_format format = palette_format::matrix);
+
+// Looks up the two frames around the (looped) time and lerps between them
+void sample_baked_animation(baked_animation const & animation, float time, glm::mat4 * palette);
+void sample_baked_animation(baked_animation const & animation, float time, dual_quaternion * palette);
+
+// Header followed by the raw frame data, which can be uploaded as is to an RGBA32F texture
+// with bone_count * stride() / 4 texels per row and one row per frame, or to a buffer
+void write_baked_animation(std::ostream & output, baked_animation const & animation);
+baked_animation read_baked_animation(std::istream & input);
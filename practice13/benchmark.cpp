@@ -0,0 +1,496 @@
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+#include <cassert>
+#include <cstdint>
+#include <sstream>
+#include <limits>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+
+#include "gltf_loader.hpp"
+#include "skinning.hpp"
+#include "cpu_skinning.hpp"
+#include "thread_pool.hpp"
+#include "animation_compression.hpp"
+#include "animation_blending.hpp"
+#include "crowd.hpp"
+#include "baked_animation.hpp"
+
+namespace
+{
+
+    template <typename F>
+    double measure_microseconds(int iterations, F && f)
+    {
+        auto const start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            f(i);
+        auto const end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(end - start).count() / iterations;
+    }
+
+    skinned_vertex reference_skinning(gltf_model const & model, gltf_model::primitive const & primitive, glm::mat4 const * palette, std::size_t i)
+    {
+        assert(primitive.joints.type == 0x1401); // GL_UNSIGNED_BYTE
+
+        auto const position = reinterpret_cast<glm::vec3 const *>(model.buffer.data() + primitive.position.view.offset)[i];
+        auto const normal = reinterpret_cast<glm::vec3 const *>(model.buffer.data() + primitive.normal.view.offset)[i];
+        auto const joints = reinterpret_cast<std::uint8_t const *>(model.buffer.data() + primitive.joints.view.offset) + 4 * i;
+        auto const weights = reinterpret_cast<glm::vec4 const *>(model.buffer.data() + primitive.weights.view.offset)[i];
+
+        glm::mat4 transform(0.f);
+        for (int k = 0; k < 4; ++k)
+            transform += weights[k] * palette[joints[k]];
+
+        return {glm::vec3(transform * glm::vec4(position, 1.f)), glm::normalize(glm::mat3(transform) * normal)};
+    }
+
+    // Writes a one-bone glTF with a STEP translation track and CUBICSPLINE scale and rotation tracks, loads it
+    // back and checks samples against values worked out by hand; throws on mismatch
+    void check_interpolation_modes()
+    {
+        auto const directory = std::filesystem::temp_directory_path();
+        auto const gltf_path = directory / "interpolation_check.gltf";
+
+        std::vector<float> data;
+        auto append = [&](std::initializer_list<float> values)
+        {
+            std::size_t const offset = data.size() * sizeof(float);
+            data.insert(data.end(), values);
+            return offset;
+        };
+
+        auto const bind_offset = append({1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f});
+        auto const step_input = append({0.f, 1.f, 2.f});
+        auto const step_output = append({0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 2.f, 0.f, 0.f});
+        auto const cubic_input = append({0.f, 2.f});
+        // (in-tangent, value, out-tangent) per key; the in-tangent of the first key and the out-tangent
+        // of the last one are never used, so they hold garbage that must not leak into the result
+        auto const scale_output = append({
+            9.f, 9.f, 9.f,  1.f, 1.f, 1.f,  2.f, 0.f, 0.f,
+            0.f, 0.f, 0.f,  3.f, 1.f, 1.f,  9.f, 9.f, 9.f,
+        });
+        float const s45 = std::sqrt(0.5f);
+        auto const rotation_output = append({
+            9.f, 9.f, 9.f, 9.f,  0.f, 0.f, 0.f, 1.f,  0.f, 0.f, 0.f, 0.f,
+            0.f, 0.f, 0.f, 0.f,  0.f, 0.f, s45, s45,  9.f, 9.f, 9.f, 9.f,
+        });
+
+        {
+            std::ofstream bin(directory / "interpolation_check.bin", std::ios::binary);
+            bin.write(reinterpret_cast<char const *>(data.data()), data.size() * sizeof(float));
+        }
+
+        auto view = [](std::size_t offset, std::size_t length)
+        {
+            return "{\"buffer\": 0, \"byteOffset\": " + std::to_string(offset) + ", \"byteLength\": " + std::to_string(length) + "}";
+        };
+        auto accessor = [](int view, int count, char const * type)
+        {
+            return "{\"bufferView\": " + std::to_string(view) + ", \"componentType\": 5126, \"count\": " + std::to_string(count)
+                + ", \"type\": \"" + type + "\"}";
+        };
+
+        {
+            std::ofstream gltf(gltf_path);
+            gltf << "{\"buffers\": [{\"uri\": \"interpolation_check.bin\", \"byteLength\": " << data.size() * sizeof(float) << "}],"
+                << "\"bufferViews\": [" << view(bind_offset, 64) << ", " << view(step_input, 12) << ", " << view(step_output, 36) << ", "
+                << view(cubic_input, 8) << ", " << view(scale_output, 72) << ", " << view(rotation_output, 96) << "],"
+                << "\"accessors\": [" << accessor(0, 1, "MAT4") << ", " << accessor(1, 3, "SCALAR") << ", " << accessor(2, 3, "VEC3") << ", "
+                << accessor(3, 2, "SCALAR") << ", " << accessor(4, 6, "VEC3") << ", " << accessor(5, 6, "VEC4") << "],"
+                << "\"meshes\": [], \"nodes\": [{\"name\": \"root\"}], \"skins\": [{\"joints\": [0], \"inverseBindMatrices\": 0}],"
+                << "\"animations\": [{\"name\": \"check\","
+                << "\"samplers\": [{\"input\": 1, \"output\": 2, \"interpolation\": \"STEP\"},"
+                << "{\"input\": 3, \"output\": 4, \"interpolation\": \"CUBICSPLINE\"},"
+                << "{\"input\": 3, \"output\": 5, \"interpolation\": \"CUBICSPLINE\"}],"
+                << "\"channels\": [{\"sampler\": 0, \"target\": {\"node\": 0, \"path\": \"translation\"}},"
+                << "{\"sampler\": 1, \"target\": {\"node\": 0, \"path\": \"scale\"}},"
+                << "{\"sampler\": 2, \"target\": {\"node\": 0, \"path\": \"rotation\"}}]}]}";
+        }
+
+        auto const model = load_gltf(gltf_path);
+        auto const & bone = model.animations.at("check").bones.at(0);
+
+        auto check = [](char const * what, float time, glm::vec3 const & value, glm::vec3 const & expected)
+        {
+            if (glm::distance(value, expected) > 1e-5f)
+                throw std::runtime_error(std::string(what) + " at " + std::to_string(time) + " is (" + std::to_string(value.x) + ", "
+                    + std::to_string(value.y) + ", " + std::to_string(value.z) + "), expected (" + std::to_string(expected.x) + ", "
+                    + std::to_string(expected.y) + ", " + std::to_string(expected.z) + ")");
+        };
+
+        // STEP holds the previous key until the next one is reached
+        check("STEP translation", 0.5f, bone.translation(0.5f), {0.f, 0.f, 0.f});
+        check("STEP translation", 1.f, bone.translation(1.f), {1.f, 0.f, 0.f});
+        check("STEP translation", 1.5f, bone.translation(1.5f), {1.f, 0.f, 0.f});
+
+        // Hermite over [0, 2] with p0 = 1, m0 = 2 * 2, p1 = 3, m1 = 0 along x
+        check("CUBICSPLINE scale", 0.5f, bone.scale(0.5f), {1.875f, 1.f, 1.f});
+        check("CUBICSPLINE scale", 1.f, bone.scale(1.f), {2.5f, 1.f, 1.f});
+
+        // Zero tangents halfway between identity and 90 degrees around z give 45 degrees around z
+        check("CUBICSPLINE rotation", 1.f, bone.rotation(1.f) * glm::vec3(1.f, 0.f, 0.f), {s45, s45, 0.f});
+
+        std::filesystem::remove(gltf_path);
+        std::filesystem::remove(directory / "interpolation_check.bin");
+    }
+
+}
+
+int main() try
+{
+    check_interpolation_modes();
+    std::cout << "STEP and CUBICSPLINE sampling: ok" << std::endl;
+
+    const std::string project_root = PROJECT_ROOT;
+    const std::string model_path = project_root + "/dancing/dancing.gltf";
+
+    auto const model = load_gltf(model_path);
+    auto const & animation = model.animations.at("hip-hop");
+
+    int const characters = 10000;
+
+    std::vector<bone_pose> pose(model.bones.size());
+    aligned_vector<glm::mat4> global(model.bones.size());
+    aligned_vector<glm::mat4> palette(model.bones.size());
+
+    float checksum = 0.f;
+
+    auto time_of = [&](int character)
+    {
+        return animation.max_time * character / characters;
+    };
+
+    double const sampling = measure_microseconds(characters, [&](int i)
+    {
+        sample_animation(animation, time_of(i), pose.data());
+        checksum += pose[0].translation.x;
+    });
+
+    double const palette_time = measure_microseconds(characters, [&](int)
+    {
+        compute_bone_palette(model.bones, pose.data(), global.data(), palette.data());
+        checksum += palette.back()[3][0];
+    });
+
+    std::cout << "Bones: " << model.bones.size() << std::endl;
+    std::cout << "Pose sampling: " << sampling << " us per character" << std::endl;
+    std::cout << "Skinning palette: " << palette_time << " us per character" << std::endl;
+
+    thread_pool pool;
+
+    std::size_t vertex_count = 0;
+    std::vector<std::vector<skinned_vertex>> skinned;
+    for (auto const & mesh : model.meshes)
+        for (auto const & primitive : mesh.primitives)
+        {
+            skinned.emplace_back(primitive.position.count);
+            vertex_count += primitive.position.count;
+        }
+
+    auto skin_all = [&](auto && skin)
+    {
+        std::size_t index = 0;
+        for (auto const & mesh : model.meshes)
+            for (auto const & primitive : mesh.primitives)
+                skin(primitive, skinned[index++].data());
+    };
+
+    int const skinning_iterations = 200;
+
+    double const skinning_single = measure_microseconds(skinning_iterations, [&](int)
+    {
+        skin_all([&](auto const & primitive, skinned_vertex * output){
+            skin_vertices(model, primitive, palette.data(), 0, primitive.position.count, output);
+        });
+    });
+
+    double const skinning_parallel = measure_microseconds(skinning_iterations, [&](int)
+    {
+        skin_all([&](auto const & primitive, skinned_vertex * output){
+            skin_vertices(pool, model, primitive, palette.data(), output);
+        });
+    });
+
+    float max_position_error = 0.f;
+    float max_normal_error = 0.f;
+    {
+        std::size_t index = 0;
+        for (auto const & mesh : model.meshes)
+            for (auto const & primitive : mesh.primitives)
+            {
+                auto const & output = skinned[index++];
+                for (std::size_t i = 0; i < output.size(); ++i)
+                {
+                    auto const reference = reference_skinning(model, primitive, palette.data(), i);
+                    max_position_error = std::max(max_position_error, glm::length(reference.position - output[i].position));
+                    max_normal_error = std::max(max_normal_error, glm::length(reference.normal - output[i].normal));
+                }
+            }
+    }
+
+    std::cout << "CPU skinning, " << vertex_count << " vertices:" << std::endl;
+    std::cout << "  1 thread: " << skinning_single << " us per character" << std::endl;
+    std::cout << "  " << pool.thread_count() << " threads: " << skinning_parallel << " us per character" << std::endl;
+    std::cout << "  max error vs reference: position " << max_position_error << ", normal " << max_normal_error << std::endl;
+    std::vector<dual_quaternion> dq_palette(model.bones.size());
+    float dq_scale = 1.f;
+
+    double const dq_palette_time = measure_microseconds(characters, [&](int)
+    {
+        dq_scale = compute_dual_quaternion_palette(palette.data(), palette.size(), dq_palette.data());
+        checksum += dq_palette.back().dual.x;
+    });
+
+    auto linear_skinned = skinned;
+
+    double const dq_skinning_single = measure_microseconds(skinning_iterations, [&](int)
+    {
+        skin_all([&](auto const & primitive, skinned_vertex * output){
+            skin_vertices_dual_quaternion(model, primitive, dq_palette.data(), dq_scale, 0, primitive.position.count, output);
+        });
+    });
+
+    double const dq_skinning_parallel = measure_microseconds(skinning_iterations, [&](int)
+    {
+        skin_all([&](auto const & primitive, skinned_vertex * output){
+            skin_vertices_dual_quaternion(pool, model, primitive, dq_palette.data(), dq_scale, output);
+        });
+    });
+
+    float max_dq_difference = 0.f;
+    double mean_dq_difference = 0.0;
+    for (std::size_t p = 0; p < skinned.size(); ++p)
+        for (std::size_t i = 0; i < skinned[p].size(); ++i)
+        {
+            float const difference = glm::length(skinned[p][i].position - linear_skinned[p][i].position);
+            max_dq_difference = std::max(max_dq_difference, difference);
+            mean_dq_difference += difference / vertex_count;
+        }
+
+    std::cout << "Dual quaternion skinning (palette " << sizeof(dual_quaternion) << " vs " << sizeof(glm::mat4) << " bytes per bone):" << std::endl;
+    std::cout << "  palette conversion: " << dq_palette_time << " us per character" << std::endl;
+    std::cout << "  1 thread: " << dq_skinning_single << " us per character" << std::endl;
+    std::cout << "  " << pool.thread_count() << " threads: " << dq_skinning_parallel << " us per character" << std::endl;
+    std::cout << "  difference from linear blend: max " << max_dq_difference << ", mean " << mean_dq_difference << std::endl;
+    std::cout << "Animation compression:" << std::endl;
+    for (auto const & [name, clip] : model.animations)
+    {
+        animation_compression_stats stats;
+        auto const compressed = compress_animation(model.bones, clip, {}, &stats);
+
+        std::stringstream blob;
+        write_compressed_animation(blob, compressed);
+        auto const loaded = read_compressed_animation(blob);
+
+        double const compressed_sampling = measure_microseconds(characters, [&](int i)
+        {
+            sample_animation(loaded, clip.max_time * i / characters, pose.data());
+            checksum += pose[0].translation.x;
+        });
+
+        std::cout << "  " << name << ": " << stats.original_size << " -> " << stats.compressed_size << " bytes ("
+            << (100.0 * stats.compressed_size / stats.original_size) << "%), max error " << stats.max_error
+            << ", sampling " << compressed_sampling << " us per character" << std::endl;
+    }
+
+    {
+        pose_pool pool(model.bones.size(), 4);
+        std::vector<float> upper_body(model.bones.size(), 0.f);
+        fill_bone_mask(model.bones, find_bone(model.bones, "mixamorig:Spine"), 1.f, upper_body.data());
+
+        animation_player player;
+        player.play(model.animations.at("rumba"));
+        player.play(model.animations.at("hip-hop"), 1.f);
+        player.update(0.5f);
+
+        auto const & layer_clip = model.animations.at("flair");
+
+        pooled_pose reference(pool);
+        sample_animation(layer_clip, 0.f, reference.data());
+
+        double const blending = measure_microseconds(characters, [&](int i)
+        {
+            pooled_pose result(pool);
+            pooled_pose layer(pool);
+
+            player.sample(pool, result.data());
+
+            sample_animation(layer_clip, layer_clip.max_time * i / characters, layer.data());
+            make_additive_pose(layer.data(), reference.data(), model.bones.size(), layer.data());
+            add_pose(result.data(), layer.data(), 0.5f, upper_body.data(), model.bones.size(), result.data());
+
+            checksum += result.data()[0].translation.x;
+        });
+
+        std::cout << "Crossfade of two clips + masked additive layer: " << blending << " us per character" << std::endl;
+    }
+
+    {
+        std::vector<gltf_model::animation> clips;
+        for (auto const & [name, clip] : model.animations)
+            clips.push_back(decompress_animation(compress_animation(model.bones, clip)));
+
+        std::size_t const crowd_size = 1000;
+        int const crowd_frames = 20;
+        float const dt = 1.f / 60.f;
+
+        std::vector<unsigned int> thread_counts;
+        unsigned int const hardware_threads = std::max(std::thread::hardware_concurrency(), 1u);
+        for (unsigned int t = 1; t < hardware_threads; t *= 2)
+            thread_counts.push_back(t);
+        thread_counts.push_back(hardware_threads);
+
+        std::cout << "Crowd update, " << crowd_size << " characters sharing " << clips.size() << " decoded clips:" << std::endl;
+        for (unsigned int threads : thread_counts)
+        {
+            thread_pool crowd_pool(threads);
+            crowd dancers(model.bones, crowd_size, threads);
+
+            for (std::size_t i = 0; i < crowd_size; ++i)
+            {
+                auto & clip = clips[i % clips.size()];
+                dancers.instance(i).play(clips[(i + 1) % clips.size()]);
+                dancers.instance(i).update(clip.max_time * i / crowd_size);
+                dancers.instance(i).play(clip, 0.5f);
+            }
+
+            double const frame = measure_microseconds(crowd_frames, [&](int)
+            {
+                dancers.update(crowd_pool, dt);
+                checksum += dancers.palette(crowd_size - 1)[0][3][0];
+            });
+
+            std::cout << "  " << threads << " threads: " << (crowd_size * 1000.0 / frame) << " characters per ms, "
+                << crowd_pool.steal_count() << " chunks stolen" << std::endl;
+        }
+    }
+
+    {
+        // Bind pose joint positions, skinned by each palette to measure baking error
+        std::vector<glm::vec3> probes;
+        for (auto const & bone : model.bones)
+            probes.push_back(glm::vec3(glm::inverse(bone.inverse_bind_matrix)[3]));
+
+        int const error_samples = 500;
+
+        std::cout << "Baked " << animation.max_time << " s clip (full evaluation: "
+            << (sampling + palette_time) << " us per character, " << memory_size(animation) << " bytes):" << std::endl;
+
+        for (auto format : {palette_format::matrix, palette_format::dual_quaternion})
+        {
+            for (float rate : {15.f, 30.f, 60.f})
+            {
+                auto const baked = bake_animation(model.bones, animation, rate, format);
+
+                std::stringstream blob;
+                write_baked_animation(blob, baked);
+                auto const loaded = read_baked_animation(blob);
+
+                double playback;
+                float max_error = 0.f;
+
+                auto reference = [&](float time)
+                {
+                    sample_animation(animation, time, pose.data());
+                    compute_bone_palette(model.bones, pose.data(), global.data(), palette.data());
+                };
+
+                if (format == palette_format::matrix)
+                {
+                    aligned_vector<glm::mat4> baked_palette(model.bones.size());
+
+                    playback = measure_microseconds(characters, [&](int i)
+                    {
+                        sample_baked_animation(loaded, time_of(i), baked_palette.data());
+                        checksum += baked_palette.back()[3][0];
+                    });
+
+                    for (int i = 0; i < error_samples; ++i)
+                    {
+                        float const time = animation.max_time * (i + 0.5f) / error_samples;
+                        reference(time);
+                        sample_baked_animation(loaded, time, baked_palette.data());
+                        for (std::size_t b = 0; b < probes.size(); ++b)
+                            max_error = std::max(max_error, glm::distance(
+                                glm::vec3(palette[b] * glm::vec4(probes[b], 1.f)),
+                                glm::vec3(baked_palette[b] * glm::vec4(probes[b], 1.f))));
+                    }
+                }
+                else
+                {
+                    std::vector<dual_quaternion> baked_palette(model.bones.size());
+
+                    playback = measure_microseconds(characters, [&](int i)
+                    {
+                        sample_baked_animation(loaded, time_of(i), baked_palette.data());
+                        checksum += baked_palette.back().dual.x;
+                    });
+
+                    for (int i = 0; i < error_samples; ++i)
+                    {
+                        float const time = animation.max_time * (i + 0.5f) / error_samples;
+                        reference(time);
+                        sample_baked_animation(loaded, time, baked_palette.data());
+                        for (std::size_t b = 0; b < probes.size(); ++b)
+                        {
+                            auto const & dq = baked_palette[b];
+                            glm::vec3 const r(dq.real.x, dq.real.y, dq.real.z);
+                            glm::vec3 const d(dq.dual.x, dq.dual.y, dq.dual.z);
+                            glm::vec3 const translation = 2.f * (dq.real.w * d - dq.dual.w * r + glm::cross(r, d));
+                            glm::vec3 const skinned = glm::rotate(dq.real, loaded.scale * probes[b]) + translation;
+                            max_error = std::max(max_error, glm::distance(glm::vec3(palette[b] * glm::vec4(probes[b], 1.f)), skinned));
+                        }
+                    }
+                }
+
+                std::cout << "  " << (format == palette_format::matrix ? "matrices" : "dual quaternions") << " at " << rate << " fps: "
+                    << loaded.memory_size() << " bytes, " << playback << " us per character, max error " << max_error << std::endl;
+            }
+        }
+    }
+
+    {
+        sample_animation(animation, animation.max_time * 0.37f, pose.data());
+        compute_bone_palette(model.bones, pose.data(), global.data(), palette.data());
+        skin_all([&](auto const & primitive, skinned_vertex * output){
+            skin_vertices(pool, model, primitive, palette.data(), output);
+        });
+
+        glm::vec3 bounds_min, bounds_max;
+
+        double const bounds_time = measure_microseconds(characters, [&](int)
+        {
+            compute_skinned_bounds(model.bones, global.data(), bounds_min, bounds_max);
+            checksum += bounds_max.y;
+        });
+
+        glm::vec3 tight_min(std::numeric_limits<float>::infinity());
+        glm::vec3 tight_max(-std::numeric_limits<float>::infinity());
+        std::size_t outside = 0;
+        for (auto const & output : skinned)
+            for (auto const & vertex : output)
+            {
+                tight_min = glm::min(tight_min, vertex.position);
+                tight_max = glm::max(tight_max, vertex.position);
+                if (glm::any(glm::lessThan(vertex.position, bounds_min - 1e-3f)) || glm::any(glm::greaterThan(vertex.position, bounds_max + 1e-3f)))
+                    ++outside;
+            }
+
+        auto volume = [](glm::vec3 const & min, glm::vec3 const & max){ return (max.x - min.x) * (max.y - min.y) * (max.z - min.z); };
+
+        std::cout << "Skinned bounds from bone boxes: " << bounds_time << " us per character, "
+            << (volume(bounds_min, bounds_max) / volume(tight_min, tight_max)) << "x the tight box volume, "
+            << outside << " vertices outside" << std::endl;
+    }
+
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
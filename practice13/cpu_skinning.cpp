@@ -0,0 +1,252 @@
+#include "cpu_skinning.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SKINNING_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+
+    template <typename T>
+    T const * accessor_data(gltf_model const & model, gltf_model::accessor const & accessor)
+    {
+        return reinterpret_cast<T const *>(model.buffer.data() + accessor.view.offset);
+    }
+
+    template <typename Joint, typename Kernel>
+    void skin_range(gltf_model const & model, gltf_model::primitive const & primitive,
+        std::size_t begin, std::size_t end, skinned_vertex * output, Kernel const & kernel)
+    {
+        auto const positions = accessor_data<glm::vec3>(model, primitive.position);
+        auto const normals = accessor_data<glm::vec3>(model, primitive.normal);
+        auto const joints = accessor_data<Joint>(model, primitive.joints);
+        auto const weights = accessor_data<glm::vec4>(model, primitive.weights);
+
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            Joint const * j = joints + 4 * i;
+            unsigned int const joint[4] = {j[0], j[1], j[2], j[3]};
+            kernel(positions[i], normals[i], joint, weights[i], output[i]);
+        }
+    }
+
+    template <typename Kernel>
+    void skin_range(gltf_model const & model, gltf_model::primitive const & primitive,
+        std::size_t begin, std::size_t end, skinned_vertex * output, Kernel const & kernel)
+    {
+        assert(primitive.position.type == 0x1406 && primitive.position.size == 3); // GL_FLOAT
+        assert(primitive.normal.type == 0x1406 && primitive.normal.size == 3);
+        assert(primitive.weights.type == 0x1406 && primitive.weights.size == 4);
+        assert(primitive.joints.size == 4);
+        assert(end <= primitive.position.count);
+
+        if (primitive.joints.type == 0x1401) // GL_UNSIGNED_BYTE
+            skin_range<std::uint8_t>(model, primitive, begin, end, output, kernel);
+        else if (primitive.joints.type == 0x1403) // GL_UNSIGNED_SHORT
+            skin_range<std::uint16_t>(model, primitive, begin, end, output, kernel);
+        else
+            throw std::runtime_error("Unsupported joints component type: " + std::to_string(primitive.joints.type));
+    }
+
+    std::size_t chunk_size(thread_pool const & pool, std::size_t count)
+    {
+        return std::max<std::size_t>(256, count / (4 * pool.thread_count()) + 1);
+    }
+
+#ifdef SKINNING_SSE
+
+    // Quaternions load as (x, y, z, w), vectors as (x, y, z, 0)
+    static_assert(sizeof(glm::quat) == 4 * sizeof(float));
+
+    __m128 load(glm::quat const & q)
+    {
+#ifdef GLM_FORCE_QUAT_DATA_XYZW
+        return _mm_loadu_ps(&q.x);
+#else
+        __m128 const wxyz = _mm_loadu_ps(&q.w);
+        return _mm_shuffle_ps(wxyz, wxyz, _MM_SHUFFLE(0, 3, 2, 1));
+#endif
+    }
+
+    __m128 load(glm::vec3 const & v)
+    {
+        return _mm_setr_ps(v.x, v.y, v.z, 0.f);
+    }
+
+    // Dot product of all four components, in every component
+    __m128 dot(__m128 a, __m128 b)
+    {
+        __m128 const m = _mm_mul_ps(a, b);
+        __m128 const s = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+    }
+
+    // Cross product of the xyz parts; w of the result is zero
+    __m128 cross(__m128 a, __m128 b)
+    {
+        __m128 const a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 const b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 const c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+        return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+    }
+
+    __m128 broadcast_w(__m128 a)
+    {
+        return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+
+    // v + 2 r x (r x v + w v) for a unit quaternion; w of v must be zero, and stays so
+    __m128 rotate(__m128 q, __m128 v)
+    {
+        __m128 const t = _mm_add_ps(cross(q, v), _mm_mul_ps(broadcast_w(q), v));
+        __m128 const r = cross(q, t);
+        return _mm_add_ps(v, _mm_add_ps(r, r));
+    }
+
+#endif
+
+}
+
+void skin_vertices(gltf_model const & model, gltf_model::primitive const & primitive, glm::mat4 const * palette,
+    std::size_t begin, std::size_t end, skinned_vertex * output)
+{
+    skin_range(model, primitive, begin, end, output, [palette](glm::vec3 const & p, glm::vec3 const & n,
+        unsigned int const * j, glm::vec4 const & w, skinned_vertex & result)
+    {
+#ifdef SKINNING_SSE
+        __m128 const w0 = _mm_set1_ps(w.x);
+        __m128 const w1 = _mm_set1_ps(w.y);
+        __m128 const w2 = _mm_set1_ps(w.z);
+        __m128 const w3 = _mm_set1_ps(w.w);
+
+        __m128 column[4];
+        for (int c = 0; c < 4; ++c)
+        {
+            __m128 v = _mm_mul_ps(w0, _mm_loadu_ps(&palette[j[0]][c][0]));
+            v = _mm_add_ps(v, _mm_mul_ps(w1, _mm_loadu_ps(&palette[j[1]][c][0])));
+            v = _mm_add_ps(v, _mm_mul_ps(w2, _mm_loadu_ps(&palette[j[2]][c][0])));
+            v = _mm_add_ps(v, _mm_mul_ps(w3, _mm_loadu_ps(&palette[j[3]][c][0])));
+            column[c] = v;
+        }
+
+        __m128 normal = _mm_mul_ps(column[0], _mm_set1_ps(n.x));
+        normal = _mm_add_ps(normal, _mm_mul_ps(column[1], _mm_set1_ps(n.y)));
+        normal = _mm_add_ps(normal, _mm_mul_ps(column[2], _mm_set1_ps(n.z)));
+
+        __m128 position = _mm_mul_ps(column[0], _mm_set1_ps(p.x));
+        position = _mm_add_ps(position, _mm_mul_ps(column[1], _mm_set1_ps(p.y)));
+        position = _mm_add_ps(position, _mm_mul_ps(column[2], _mm_set1_ps(p.z)));
+        position = _mm_add_ps(position, column[3]);
+
+        alignas(16) float result_position[4];
+        alignas(16) float result_normal[4];
+        _mm_store_ps(result_position, position);
+        _mm_store_ps(result_normal, normal);
+
+        result.position = glm::vec3(result_position[0], result_position[1], result_position[2]);
+        result.normal = glm::normalize(glm::vec3(result_normal[0], result_normal[1], result_normal[2]));
+#else
+        glm::mat4 const transform = w.x * palette[j[0]] + w.y * palette[j[1]] + w.z * palette[j[2]] + w.w * palette[j[3]];
+        result.position = glm::vec3(transform * glm::vec4(p, 1.f));
+        result.normal = glm::normalize(glm::mat3(transform) * n);
+#endif
+    });
+}
+
+void skin_vertices_dual_quaternion(gltf_model const & model, gltf_model::primitive const & primitive, dual_quaternion const * palette,
+    float scale, std::size_t begin, std::size_t end, skinned_vertex * output)
+{
+    skin_range(model, primitive, begin, end, output, [palette, scale](glm::vec3 const & p, glm::vec3 const & n,
+        unsigned int const * j, glm::vec4 const & w, skinned_vertex & result)
+    {
+#ifdef SKINNING_SSE
+        // Blend in the hemisphere of the first influence to avoid taking the long way around
+        __m128 const pivot = load(palette[j[0]].real);
+        __m128 const sign_bit = _mm_set1_ps(-0.f);
+
+        __m128 real = _mm_setzero_ps();
+        __m128 dual = _mm_setzero_ps();
+        for (int k = 0; k < 4; ++k)
+        {
+            __m128 const q_real = load(palette[j[k]].real);
+            __m128 const q_dual = load(palette[j[k]].dual);
+            __m128 const flip = _mm_and_ps(_mm_cmplt_ps(dot(pivot, q_real), _mm_setzero_ps()), sign_bit);
+            __m128 const weight = _mm_xor_ps(_mm_set1_ps(w[k]), flip);
+            real = _mm_add_ps(real, _mm_mul_ps(q_real, weight));
+            dual = _mm_add_ps(dual, _mm_mul_ps(q_dual, weight));
+        }
+
+        __m128 const inverse_norm = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(dot(real, real)));
+        real = _mm_mul_ps(real, inverse_norm);
+        dual = _mm_mul_ps(dual, inverse_norm);
+
+        // 2 (w_r d - w_d r + r x d), only the xyz parts of r and d take part in the cross product
+        __m128 translation = _mm_sub_ps(_mm_mul_ps(broadcast_w(real), dual), _mm_mul_ps(broadcast_w(dual), real));
+        translation = _mm_add_ps(translation, cross(real, dual));
+        translation = _mm_add_ps(translation, translation);
+
+        __m128 const position = _mm_add_ps(rotate(real, _mm_mul_ps(_mm_set1_ps(scale), load(p))), translation);
+        __m128 const normal = rotate(real, load(n));
+
+        alignas(16) float result_position[4];
+        alignas(16) float result_normal[4];
+        _mm_store_ps(result_position, position);
+        _mm_store_ps(result_normal, normal);
+
+        result.position = glm::vec3(result_position[0], result_position[1], result_position[2]);
+        result.normal = glm::normalize(glm::vec3(result_normal[0], result_normal[1], result_normal[2]));
+#else
+        // Blend in the hemisphere of the first influence to avoid taking the long way around
+        glm::quat const & pivot = palette[j[0]].real;
+
+        glm::quat real(0.f, 0.f, 0.f, 0.f);
+        glm::quat dual(0.f, 0.f, 0.f, 0.f);
+        for (int k = 0; k < 4; ++k)
+        {
+            auto const & q = palette[j[k]];
+            float const weight = (glm::dot(pivot, q.real) < 0.f) ? -w[k] : w[k];
+            real = real + q.real * weight;
+            dual = dual + q.dual * weight;
+        }
+
+        float const inverse_norm = 1.f / glm::length(real);
+        real = real * inverse_norm;
+        dual = dual * inverse_norm;
+
+        glm::vec3 const r(real.x, real.y, real.z);
+        glm::vec3 const d(dual.x, dual.y, dual.z);
+        glm::vec3 const translation = 2.f * (real.w * d - dual.w * r + glm::cross(r, d));
+
+        result.position = glm::rotate(real, scale * p) + translation;
+        result.normal = glm::normalize(glm::rotate(real, n));
+#endif
+    });
+}
+
+void skin_vertices(thread_pool & pool, gltf_model const & model, gltf_model::primitive const & primitive, glm::mat4 const * palette,
+    skinned_vertex * output)
+{
+    std::size_t const count = primitive.position.count;
+
+    pool.parallel_for(count, chunk_size(pool, count), [&](std::size_t begin, std::size_t end)
+    {
+        skin_vertices(model, primitive, palette, begin, end, output);
+    });
+}
+
+void skin_vertices_dual_quaternion(thread_pool & pool, gltf_model const & model, gltf_model::primitive const & primitive, dual_quaternion const * palette,
+    float scale, skinned_vertex * output)
+{
+    std::size_t const count = primitive.position.count;
+
+    pool.parallel_for(count, chunk_size(pool, count), [&](std::size_t begin, std::size_t end)
+    {
+        skin_vertices_dual_quaternion(model, primitive, palette, scale, begin, end, output);
+    });
+}
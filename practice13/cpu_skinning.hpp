@@ -0,0 +1,25 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "skinning.hpp"
+#include "thread_pool.hpp"
+
+struct skinned_vertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+};
+
+// Linear blend skinning of vertices [begin, end) of the primitive, output is indexed by vertex
+void skin_vertices(gltf_model const & model, gltf_model::primitive const & primitive, glm::mat4 const * palette,
+    std::size_t begin, std::size_t end, skinned_vertex * output);
+
+void skin_vertices(thread_pool & pool, gltf_model const & model, gltf_model::primitive const & primitive, glm::mat4 const * palette,
+    skinned_vertex * output);
+
+// Dual quaternion skinning, scale is the skeleton-wide uniform scale returned by compute_dual_quaternion_palette
+void skin_vertices_dual_quaternion(gltf_model const & model, gltf_model::primitive const & primitive, dual_quaternion const * palette,
+    float scale, std::size_t begin, std::size_t end, skinned_vertex * output);
+
+void skin_vertices_dual_quaternion(thread_pool & pool, gltf_model const & model, gltf_model::primitive const & primitive, dual_quaternion const * palette,
+    float scale, skinned_vertex * output);
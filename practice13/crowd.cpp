@@ -0,0 +1,39 @@
+#include "crowd.hpp"
+
+crowd::scratch::scratch(std::size_t bone_count)
+    : poses(bone_count, 2)
+    , global(bone_count)
+{}
+
+crowd::crowd(std::vector<gltf_model::bone> const & bones, std::size_t instance_count, unsigned int thread_count)
+    : bones(&bones)
+    , players(instance_count)
+    , palettes(instance_count * bones.size())
+{
+    for (unsigned int i = 0; i < std::max(thread_count, 1u); ++i)
+        workers.push_back(std::make_unique<scratch>(bones.size()));
+}
+
+void crowd::update(thread_pool & pool, float dt)
+{
+    assert(pool.thread_count() <= workers.size());
+
+    std::size_t const chunk_size = std::max<std::size_t>(1, size() / (8 * pool.thread_count()));
+
+    pool.parallel_for(size(), chunk_size, [&](std::size_t begin, std::size_t end, unsigned int worker)
+    {
+        auto & local = *workers[worker];
+        pooled_pose pose(local.poses);
+
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            auto & player = players[i];
+            if (!player.current)
+                continue;
+
+            player.update(dt);
+            player.sample(local.poses, pose.data());
+            compute_bone_palette(*bones, pose.data(), local.global.data(), palettes.data() + i * bone_count());
+        }
+    });
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "skinning.hpp"
+#include "animation_blending.hpp"
+#include "thread_pool.hpp"
+
+#include <memory>
+
+// Many instances of one skeleton; instances only hold playback state and point
+// into clips shared by the whole crowd, the outputs are per-instance bone palettes
+struct crowd
+{
+    // thread_count is the largest pool size update() will be called with
+    crowd(std::vector<gltf_model::bone> const & bones, std::size_t instance_count, unsigned int thread_count);
+
+    std::size_t size() const
+    {
+        return players.size();
+    }
+
+    std::size_t bone_count() const
+    {
+        return bones->size();
+    }
+
+    animation_player & instance(std::size_t i)
+    {
+        return players[i];
+    }
+
+    glm::mat4 const * palette(std::size_t i) const
+    {
+        return palettes.data() + i * bone_count();
+    }
+
+    // Advances, samples, blends and computes palettes of all instances across the pool
+    void update(thread_pool & pool, float dt);
+
+private:
+    struct scratch
+    {
+        pose_pool poses;
+        aligned_vector<glm::mat4> global;
+
+        explicit scratch(std::size_t bone_count);
+    };
+
+    std::vector<gltf_model::bone> const * bones;
+    std::vector<animation_player> players;
+    aligned_vector<glm::mat4> palettes;
+    std::vector<std::unique_ptr<scratch>> workers;
+};
@@ -5,6 +5,7 @@
 
 #include <fstream>
 #include <stdexcept>
+#include <cstdint>
 
 static unsigned int attribute_type_to_size(std::string const & type)
 {
@@ -123,6 +124,44 @@ gltf_model load_gltf(std::filesystem::path const & path)
                 r = glm::quat(r.z, r.w, r.x, r.y);
         };
 
+        auto parse_interpolation = [](auto const & sampler)
+        {
+            if (!sampler.HasMember("interpolation"))
+                return gltf_model::interpolation_mode::linear;
+
+            std::string const interpolation = sampler["interpolation"].GetString();
+            if (interpolation == "LINEAR")
+                return gltf_model::interpolation_mode::linear;
+            if (interpolation == "STEP")
+                return gltf_model::interpolation_mode::step;
+            if (interpolation == "CUBICSPLINE")
+                return gltf_model::interpolation_mode::cubic_spline;
+            throw std::runtime_error("Unknown interpolation: " + interpolation);
+        };
+
+        // Cubic spline outputs hold (in-tangent, value, out-tangent) triples per key
+        auto fill_spline = [&](auto & spline, gltf_model::accessor const & input, gltf_model::accessor const & output, auto const & sampler)
+        {
+            spline.interpolation = parse_interpolation(sampler);
+            fill_buffer(spline.timestamps, input);
+
+            if (spline.interpolation != gltf_model::interpolation_mode::cubic_spline)
+            {
+                fill_buffer(spline.values, output);
+                return;
+            }
+
+            std::decay_t<decltype(spline.values)> triples;
+            fill_buffer(triples, output);
+
+            for (std::size_t i = 0; i + 2 < triples.size(); i += 3)
+            {
+                spline.in_tangents.push_back(triples[i + 0]);
+                spline.values.push_back(triples[i + 1]);
+                spline.out_tangents.push_back(triples[i + 2]);
+            }
+        };
+
         auto joints = skins[0]["joints"].GetArray();
 
         std::vector<glm::mat4> inverse_bind_matrices(joints.Size());
@@ -160,6 +199,42 @@ gltf_model load_gltf(std::filesystem::path const & path)
         for (int i = 0; i < result.bones.size(); ++i)
             assert(result.bones[i].parent == -1 || result.bones[i].parent < i);
 
+        auto fill_bone_bounds = [&](gltf_model::primitive const & primitive, auto const * joints)
+        {
+            assert(primitive.position.type == 0x1406); // GL_FLOAT
+            assert(primitive.weights.type == 0x1406);
+
+            auto positions = reinterpret_cast<glm::vec3 const *>(result.buffer.data() + primitive.position.view.offset);
+            auto weights = reinterpret_cast<float const *>(result.buffer.data() + primitive.weights.view.offset);
+
+            for (std::size_t v = 0; v < primitive.position.count; ++v)
+            {
+                for (int k = 0; k < 4; ++k)
+                {
+                    if (weights[4 * v + k] <= 0.f) continue;
+
+                    auto & bone = result.bones[joints[4 * v + k]];
+                    glm::vec3 p = bone.inverse_bind_matrix * glm::vec4(positions[v], 1.f);
+                    bone.min = glm::min(bone.min, p);
+                    bone.max = glm::max(bone.max, p);
+                }
+            }
+        };
+
+        for (auto const & mesh : result.meshes)
+        {
+            for (auto const & primitive : mesh.primitives)
+            {
+                auto joints = result.buffer.data() + primitive.joints.view.offset;
+                if (primitive.joints.type == 0x1401) // GL_UNSIGNED_BYTE
+                    fill_bone_bounds(primitive, reinterpret_cast<std::uint8_t const *>(joints));
+                else if (primitive.joints.type == 0x1403) // GL_UNSIGNED_SHORT
+                    fill_bone_bounds(primitive, reinterpret_cast<std::uint16_t const *>(joints));
+                else
+                    throw std::runtime_error("Unsupported joints component type: " + std::to_string(primitive.joints.type));
+            }
+        }
+
         for (auto const & animation : document["animations"].GetArray())
         {
             std::string name = animation["name"].GetString();
@@ -185,19 +260,18 @@ gltf_model load_gltf(std::filesystem::path const & path)
 
                 if (path == "translation")
                 {
-                    fill_buffer(bone.translation.timestamps, input);
-                    fill_buffer(bone.translation.values, output);
+                    fill_spline(bone.translation, input, output, sampler);
                 }
                 else if (path == "rotation")
                 {
-                    fill_buffer(bone.rotation.timestamps, input);
-                    fill_buffer(bone.rotation.values, output);
+                    fill_spline(bone.rotation, input, output, sampler);
                     fix_rotations(bone.rotation.values);
+                    fix_rotations(bone.rotation.in_tangents);
+                    fix_rotations(bone.rotation.out_tangents);
                 }
                 else if (path == "scale")
                 {
-                    fill_buffer(bone.scale.timestamps, input);
-                    fill_buffer(bone.scale.values, output);
+                    fill_spline(bone.scale, input, output, sampler);
                 }
             }
 
@@ -6,6 +6,9 @@
 #include <optional>
 #include <unordered_map>
 #include <algorithm>
+#include <limits>
+#include <cassert>
+#include <type_traits>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -43,14 +46,32 @@ struct gltf_model
         unsigned int parent = -1;
         std::string name;
         glm::mat4 inverse_bind_matrix;
+
+        // Bounding box of the vertices this bone influences, in the bone's bind space;
+        // empty (min > max) if it influences none
+        glm::vec3 min{std::numeric_limits<float>::infinity()};
+        glm::vec3 max{-std::numeric_limits<float>::infinity()};
+    };
+
+    enum class interpolation_mode
+    {
+        linear,
+        step,
+        cubic_spline,
     };
 
     template <typename T>
     struct spline
     {
+        interpolation_mode interpolation = interpolation_mode::linear;
+
         std::vector<float> timestamps;
         std::vector<T> values;
 
+        // Only filled for cubic_spline, one per key
+        std::vector<T> in_tangents;
+        std::vector<T> out_tangents;
+
         T operator()(float time) const;
     };
 
@@ -95,36 +116,67 @@ struct gltf_model
 
 gltf_model load_gltf(std::filesystem::path const & path);
 
-template <>
-inline glm::vec3 gltf_model::spline<glm::vec3>::operator()(float time) const
+// Cubic Hermite segment as defined by glTF, tangents already scaled by the segment duration
+template <typename T>
+T hermite(T const & p0, T const & m0, T const & p1, T const & m1, float t)
 {
-    assert(!values.empty());
-
-    auto it = std::lower_bound(timestamps.begin(), timestamps.end(), time);
-    if (it == timestamps.begin())
-        return values.back();
-    if (it == timestamps.end())
-        return values.back();
+    float const t2 = t * t;
+    float const t3 = t2 * t;
+    return p0 * (2.f * t3 - 3.f * t2 + 1.f) + m0 * (t3 - 2.f * t2 + t) + p1 * (-2.f * t3 + 3.f * t2) + m1 * (t3 - t2);
+}
 
-    int i = it - timestamps.begin();
+inline glm::vec3 interpolate(glm::vec3 const & a, glm::vec3 const & b, float t)
+{
+    return glm::lerp(a, b, t);
+}
 
-    float t = (time - timestamps[i - 1]) / (timestamps[i] - timestamps[i - 1]);
-    return glm::lerp(values[i - 1], values[i], t);
+inline glm::quat interpolate(glm::quat const & a, glm::quat const & b, float t)
+{
+    return glm::slerp(a, b, t);
 }
 
-template <>
-inline glm::quat gltf_model::spline<glm::quat>::operator()(float time) const
+// Keyframe lookup shared by gltf_model::spline and compressed_animation::track: key(i) returns the i-th key,
+// the tangents are only read by cubic splines. Times before the first or past the last key give the last key
+template <typename T, typename Key>
+T sample_keys(std::vector<float> const & timestamps, float time, gltf_model::interpolation_mode interpolation,
+    Key const & key, T const * in_tangents = nullptr, T const * out_tangents = nullptr)
 {
-    assert(!values.empty());
+    assert(!timestamps.empty());
 
     auto it = std::lower_bound(timestamps.begin(), timestamps.end(), time);
     if (it == timestamps.begin())
-        return values.back();
+        return key(timestamps.size() - 1);
     if (it == timestamps.end())
-        return values.back();
+        return key(timestamps.size() - 1);
 
     int i = it - timestamps.begin();
 
-    float t = (time - timestamps[i - 1]) / (timestamps[i] - timestamps[i - 1]);
-    return glm::slerp(values[i - 1], values[i], t);
+    if (interpolation == gltf_model::interpolation_mode::step)
+        return (time < timestamps[i]) ? key(i - 1) : key(i);
+
+    float dt = timestamps[i] - timestamps[i - 1];
+    float t = (time - timestamps[i - 1]) / dt;
+
+    if (interpolation == gltf_model::interpolation_mode::cubic_spline)
+    {
+        T value = hermite(key(i - 1), out_tangents[i - 1] * dt, key(i), in_tangents[i] * dt, t);
+        if constexpr (std::is_same_v<T, glm::quat>)
+            value = glm::normalize(value);
+        return value;
+    }
+
+    return interpolate(key(i - 1), key(i), t);
+}
+
+template <typename T>
+T gltf_model::spline<T>::operator()(float time) const
+{
+    assert(values.size() == timestamps.size());
+
+    auto key = [this](std::size_t i)
+    {
+        return values[i];
+    };
+
+    return sample_keys<T>(timestamps, time, interpolation, key, in_tangents.data(), out_tangents.data());
 }
@@ -15,6 +15,8 @@
 #include <vector>
 #include <random>
 #include <map>
+#include <string>
+#include <algorithm>
 #include <cmath>
 
 #define GLM_FORCE_SWIZZLE
@@ -28,6 +30,8 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "gltf_loader.hpp"
+#include "skinning.hpp"
+#include "animation_blending.hpp"
 #include "stb_image.h"
 
 std::string to_string(std::string_view str)
@@ -52,18 +56,74 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Palettes are uniform blocks sized to the skeleton; as plain uniforms they would exceed the
+// 1024 vertex uniform components OpenGL 3.3 guarantees
+layout (std140) uniform bone_palette
+{
+    mat4 bones[BONE_COUNT];
+};
+
+uniform int use_dual_quaternions;
+layout (std140) uniform dq_bone_palette
+{
+    mat2x4 dq_bones[BONE_COUNT];
+};
+uniform float dq_scale;
+
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
 layout (location = 2) in vec2 in_texcoord;
+layout (location = 3) in ivec4 in_joints;
+layout (location = 4) in vec4 in_weights;
 
 out vec3 normal;
 out vec2 texcoord;
 
+// quaternions are stored as (w, x, y, z)
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.yzw, cross(q.yzw, v) + q.x * v);
+}
+
+mat2x4 dq_influence(int joint, float weight, vec4 pivot)
+{
+    mat2x4 dq = dq_bones[joint];
+    return (dot(pivot, dq[0]) < 0.0 ? -weight : weight) * dq;
+}
+
 void main()
 {
+    vec3 position;
+
+    if (use_dual_quaternions == 1)
+    {
+        vec4 pivot = dq_bones[in_joints.x][0];
+        mat2x4 dq = dq_influence(in_joints.x, in_weights.x, pivot)
+            + dq_influence(in_joints.y, in_weights.y, pivot)
+            + dq_influence(in_joints.z, in_weights.z, pivot)
+            + dq_influence(in_joints.w, in_weights.w, pivot);
+
+        float norm = length(dq[0]);
+        vec4 real = dq[0] / norm;
+        vec4 dual = dq[1] / norm;
+
+        vec3 translation = 2.0 * (real.x * dual.yzw - dual.x * real.yzw + cross(real.yzw, dual.yzw));
+
+        position = rotate(real, dq_scale * in_position) + translation;
+        normal = mat3(model) * rotate(real, in_normal);
+    }
+    else
+    {
+        mat4 transform = in_weights.x * bones[in_joints.x]
+            + in_weights.y * bones[in_joints.y]
+            + in_weights.z * bones[in_joints.z]
+            + in_weights.w * bones[in_joints.w];
+
+        position = (transform * vec4(in_position, 1.0)).xyz;
+        normal = mat3(model) * mat3(transform) * in_normal;
+    }
 
-    gl_Position = projection * view * model * vec4(in_position, 1.0);
-    normal = mat3(model) * in_normal;
+    gl_Position = projection * view * model * vec4(position, 1.0);
     texcoord = in_texcoord;
 }
 )";
@@ -175,7 +235,24 @@ int main() try
     if (!GLEW_VERSION_3_3)
         throw std::runtime_error("OpenGL 3.3 is not supported");
 
-    auto vertex_shader = create_shader(GL_VERTEX_SHADER, vertex_shader_source);
+    const std::string project_root = PROJECT_ROOT;
+    const std::string model_path = project_root + "/dancing/dancing.gltf";
+
+    auto const input_model = load_gltf(model_path);
+
+    // The matrix palette is the larger block, at 64 bytes per bone
+    std::size_t const bone_count = std::max<std::size_t>(input_model.bones.size(), 1);
+    GLint max_uniform_block_size;
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &max_uniform_block_size);
+    if (std::size_t const required = bone_count * sizeof(glm::mat4); required > std::size_t(max_uniform_block_size))
+        throw std::runtime_error("Skinning " + std::to_string(bone_count) + " bones needs " + std::to_string(required)
+            + "-byte uniform blocks, only " + std::to_string(max_uniform_block_size) + " bytes are supported");
+
+    // The array sizes are defined right after the #version line
+    std::string vertex_source = vertex_shader_source;
+    vertex_source.insert(vertex_source.find('\n') + 1, "#define BONE_COUNT " + std::to_string(bone_count) + "\n");
+
+    auto vertex_shader = create_shader(GL_VERTEX_SHADER, vertex_source.c_str());
     auto fragment_shader = create_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
     auto program = create_program(vertex_shader, fragment_shader);
 
@@ -186,11 +263,24 @@ int main() try
     GLuint color_location = glGetUniformLocation(program, "color");
     GLuint use_texture_location = glGetUniformLocation(program, "use_texture");
     GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
-
-    const std::string project_root = PROJECT_ROOT;
-    const std::string model_path = project_root + "/dancing/dancing.gltf";
-
-    auto const input_model = load_gltf(model_path);
+    GLuint use_dual_quaternions_location = glGetUniformLocation(program, "use_dual_quaternions");
+    GLuint dq_scale_location = glGetUniformLocation(program, "dq_scale");
+
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "bone_palette"), 0);
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "dq_bone_palette"), 1);
+
+    GLuint bones_buffer, dq_bones_buffer;
+    glGenBuffers(1, &bones_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, bones_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, bone_count * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, bones_buffer);
+
+    // std140 lays out a mat2x4 as two vec4 columns, the real and dual parts
+    static_assert(sizeof(dual_quaternion) == 8 * sizeof(float));
+    glGenBuffers(1, &dq_bones_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, dq_bones_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, bone_count * sizeof(dual_quaternion), nullptr, GL_STREAM_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 1, dq_bones_buffer);
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -259,6 +349,21 @@ int main() try
         textures[*mesh.material.texture_path] = texture;
     }
 
+    std::map<SDL_Keycode, std::string> animation_keys = {
+        {SDLK_1, "hip-hop"},
+        {SDLK_2, "rumba"},
+        {SDLK_3, "flair"},
+    };
+
+    pose_pool poses(input_model.bones.size(), 2);
+    pooled_pose pose(poses);
+
+    animation_player player;
+    player.play(input_model.animations.at("hip-hop"));
+    aligned_vector<glm::mat4> global_transforms(input_model.bones.size());
+    aligned_vector<glm::mat4> bones(input_model.bones.size());
+    std::vector<dual_quaternion> dq_bones(input_model.bones.size());
+
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
     float time = 0.f;
@@ -272,6 +377,7 @@ int main() try
     float camera_height = 1.f;
 
     bool paused = false;
+    bool use_dual_quaternions = false;
 
     bool running = true;
     while (running)
@@ -294,6 +400,10 @@ int main() try
             button_down[event.key.keysym.sym] = true;
             if (event.key.keysym.sym == SDLK_SPACE)
                 paused = !paused;
+            if (event.key.keysym.sym == SDLK_q)
+                use_dual_quaternions = !use_dual_quaternions;
+            if (auto it = animation_keys.find(event.key.keysym.sym); it != animation_keys.end())
+                player.play(input_model.animations.at(it->second), 0.5f);
             break;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
@@ -308,7 +418,10 @@ int main() try
         last_frame_start = now;
 
         if (!paused)
+        {
             time += dt;
+            player.update(dt);
+        }
 
         if (button_down[SDLK_UP])
             camera_distance -= 3.f * dt;
@@ -335,7 +448,7 @@ int main() try
         float near = 0.1f;
         float far = 100.f;
 
-        glm::mat4 model = glm::scale(glm::mat4(1.f), glm::vec3(1.f));
+        glm::mat4 model = glm::scale(glm::mat4(1.f), glm::vec3(0.01f));
 
         glm::mat4 view(1.f);
         view = glm::translate(view, {0.f, 0.f, -camera_distance});
@@ -349,11 +462,22 @@ int main() try
 
         glm::vec3 light_direction = glm::normalize(glm::vec3(1.f, 2.f, 3.f));
 
+        player.sample(poses, pose.data());
+        compute_bone_palette(input_model.bones, pose.data(), global_transforms.data(), bones.data());
+        float const dq_scale = compute_dual_quaternion_palette(bones.data(), bones.size(), dq_bones.data());
+
         glUseProgram(program);
         glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
         glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
         glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
+        glUniform1i(use_dual_quaternions_location, use_dual_quaternions ? 1 : 0);
+        glUniform1f(dq_scale_location, dq_scale);
+
+        glBindBuffer(GL_UNIFORM_BUFFER, bones_buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, bones.size() * sizeof(glm::mat4), bones.data());
+        glBindBuffer(GL_UNIFORM_BUFFER, dq_bones_buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, dq_bones.size() * sizeof(dual_quaternion), dq_bones.data());
 
         auto draw_meshes = [&](bool transparent)
         {
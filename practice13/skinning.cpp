@@ -0,0 +1,142 @@
+#include "skinning.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SKINNING_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+
+    // result = a * b, all matrices column-major; result must be 16-byte aligned
+    inline void multiply(glm::mat4 const & a, glm::mat4 const & b, glm::mat4 & result)
+    {
+#ifdef SKINNING_SSE
+        float const * pa = &a[0][0];
+        float const * pb = &b[0][0];
+        float * pr = &result[0][0];
+
+        __m128 const a0 = _mm_loadu_ps(pa + 0);
+        __m128 const a1 = _mm_loadu_ps(pa + 4);
+        __m128 const a2 = _mm_loadu_ps(pa + 8);
+        __m128 const a3 = _mm_loadu_ps(pa + 12);
+
+        for (int j = 0; j < 4; ++j)
+        {
+            __m128 c = _mm_mul_ps(a0, _mm_set1_ps(pb[4 * j + 0]));
+            c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_set1_ps(pb[4 * j + 1])));
+            c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_set1_ps(pb[4 * j + 2])));
+            c = _mm_add_ps(c, _mm_mul_ps(a3, _mm_set1_ps(pb[4 * j + 3])));
+            _mm_store_ps(pr + 4 * j, c);
+        }
+#else
+        result = a * b;
+#endif
+    }
+
+    template <typename T>
+    T sample_or(gltf_model::spline<T> const & spline, float time, T const & fallback)
+    {
+        if (spline.values.empty())
+            return fallback;
+        return spline(time);
+    }
+
+}
+
+glm::mat4 pose_to_matrix(bone_pose const & pose)
+{
+    glm::mat3 const rotation = glm::mat3_cast(pose.rotation);
+
+    glm::mat4 result;
+    result[0] = glm::vec4(rotation[0] * pose.scale.x, 0.f);
+    result[1] = glm::vec4(rotation[1] * pose.scale.y, 0.f);
+    result[2] = glm::vec4(rotation[2] * pose.scale.z, 0.f);
+    result[3] = glm::vec4(pose.translation, 1.f);
+    return result;
+}
+
+void sample_animation(gltf_model::animation const & animation, float time, bone_pose * pose)
+{
+    for (std::size_t i = 0; i < animation.bones.size(); ++i)
+    {
+        auto const & bone = animation.bones[i];
+        pose[i].translation = sample_or(bone.translation, time, glm::vec3(0.f));
+        pose[i].rotation = sample_or(bone.rotation, time, glm::quat(1.f, 0.f, 0.f, 0.f));
+        pose[i].scale = sample_or(bone.scale, time, glm::vec3(1.f));
+    }
+}
+
+void compute_bone_palette(std::vector<gltf_model::bone> const & bones, bone_pose const * pose, glm::mat4 * global, glm::mat4 * palette)
+{
+    assert(reinterpret_cast<std::uintptr_t>(global) % 16 == 0);
+    assert(reinterpret_cast<std::uintptr_t>(palette) % 16 == 0);
+
+    for (std::size_t i = 0; i < bones.size(); ++i)
+    {
+        auto const & bone = bones[i];
+
+        if (bone.parent == -1)
+            global[i] = pose_to_matrix(pose[i]);
+        else
+        {
+            assert(bone.parent < i);
+            multiply(global[bone.parent], pose_to_matrix(pose[i]), global[i]);
+        }
+
+        multiply(global[i], bone.inverse_bind_matrix, palette[i]);
+    }
+}
+
+float compute_dual_quaternion_palette(glm::mat4 const * matrix_palette, std::size_t count, dual_quaternion * palette)
+{
+    if (count == 0)
+        return 1.f;
+
+    float const scale = glm::length(glm::vec3(matrix_palette[0][0]));
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        glm::mat4 const & m = matrix_palette[i];
+
+        assert(std::abs(glm::length(glm::vec3(m[0])) - scale) <= 1e-3f * scale);
+
+        glm::quat const real = glm::normalize(glm::quat_cast(glm::mat3(m) / scale));
+        glm::vec3 const translation(m[3]);
+
+        palette[i].real = real;
+        palette[i].dual = glm::quat(0.f, translation.x, translation.y, translation.z) * real * 0.5f;
+    }
+
+    return scale;
+}
+
+void compute_skinned_bounds(std::vector<gltf_model::bone> const & bones, glm::mat4 const * global, glm::vec3 & min, glm::vec3 & max)
+{
+    min = glm::vec3(std::numeric_limits<float>::infinity());
+    max = glm::vec3(-std::numeric_limits<float>::infinity());
+
+    for (std::size_t i = 0; i < bones.size(); ++i)
+    {
+        auto const & bone = bones[i];
+        if (bone.min.x > bone.max.x)
+            continue;
+
+        glm::mat4 const & m = global[i];
+        glm::vec3 const center = (bone.min + bone.max) * 0.5f;
+        glm::vec3 const extent = (bone.max - bone.min) * 0.5f;
+
+        glm::vec3 const world_center(m * glm::vec4(center, 1.f));
+        glm::vec3 const world_extent = glm::abs(glm::vec3(m[0])) * extent.x
+            + glm::abs(glm::vec3(m[1])) * extent.y
+            + glm::abs(glm::vec3(m[2])) * extent.z;
+
+        min = glm::min(min, world_center - world_extent);
+        max = glm::max(max, world_center + world_extent);
+    }
+}
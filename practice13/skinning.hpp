@@ -0,0 +1,36 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "aligned_allocator.hpp"
+
+struct bone_pose
+{
+    glm::vec3 translation{0.f};
+    glm::quat rotation{1.f, 0.f, 0.f, 0.f};
+    glm::vec3 scale{1.f};
+};
+
+// 8 floats per bone: rotation and translation, no scale
+struct dual_quaternion
+{
+    glm::quat real;
+    glm::quat dual;
+};
+
+glm::mat4 pose_to_matrix(bone_pose const & pose);
+
+// pose must have room for animation.bones.size() entries
+void sample_animation(gltf_model::animation const & animation, float time, bone_pose * pose);
+
+// Single forward pass over the bones, relies on bones[i].parent < i;
+// global and palette must hold bones.size() 16-byte aligned matrices
+void compute_bone_palette(std::vector<gltf_model::bone> const & bones, bone_pose const * pose, glm::mat4 * global, glm::mat4 * palette);
+
+// Converts a matrix palette to dual quaternions. Palette matrices may only carry a uniform scale
+// shared by the whole skeleton (e.g. an armature scale baked into the inverse bind matrices),
+// it is factored out and returned
+float compute_dual_quaternion_palette(glm::mat4 const * matrix_palette, std::size_t count, dual_quaternion * palette);
+
+// Conservative bounds of the skinned mesh, in the same space as skinned vertices:
+// the union of every bone's bind space bounds transformed by its global matrix
+void compute_skinned_bounds(std::vector<gltf_model::bone> const & bones, glm::mat4 const * global, glm::vec3 & min, glm::vec3 & max);
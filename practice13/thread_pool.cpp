@@ -0,0 +1,148 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+    std::uint64_t pack(std::uint32_t begin, std::uint32_t end)
+    {
+        return (static_cast<std::uint64_t>(end) << 32) | begin;
+    }
+
+    std::uint32_t range_begin(std::uint64_t range)
+    {
+        return static_cast<std::uint32_t>(range);
+    }
+
+    std::uint32_t range_end(std::uint64_t range)
+    {
+        return static_cast<std::uint32_t>(range >> 32);
+    }
+
+}
+
+thread_pool::thread_pool(unsigned int thread_count)
+    : ranges(std::max(thread_count, 1u))
+{
+    for (unsigned int i = 1; i < thread_count; ++i)
+        workers.emplace_back([this, i]{ worker_loop(i); });
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+
+    for (auto & worker : workers)
+        worker.join();
+}
+
+void thread_pool::run(std::size_t count, std::size_t chunk_size, task_function function, void * context)
+{
+    if (count == 0)
+        return;
+
+    {
+        std::lock_guard lock(mutex);
+        this->function = function;
+        this->context = context;
+        this->count = count;
+        this->chunk_size = std::max<std::size_t>(chunk_size, 1);
+
+        std::size_t const chunks = (count + this->chunk_size - 1) / this->chunk_size;
+        std::size_t const participants = ranges.size();
+        for (std::size_t i = 0; i < participants; ++i)
+            ranges[i].range.store(pack(chunks * i / participants, chunks * (i + 1) / participants));
+
+        busy = workers.size();
+        ++generation;
+    }
+    wake.notify_all();
+
+    execute_chunks(0);
+
+    std::unique_lock lock(mutex);
+    done.wait(lock, [this]{ return busy == 0; });
+}
+
+bool thread_pool::pop_front(unsigned int worker, std::uint32_t & chunk)
+{
+    auto & range = ranges[worker].range;
+    auto current = range.load();
+    while (range_begin(current) < range_end(current))
+    {
+        if (range.compare_exchange_weak(current, pack(range_begin(current) + 1, range_end(current))))
+        {
+            chunk = range_begin(current);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool thread_pool::steal_back(unsigned int victim, std::uint32_t & chunk)
+{
+    auto & range = ranges[victim].range;
+    auto current = range.load();
+    while (range_begin(current) < range_end(current))
+    {
+        if (range.compare_exchange_weak(current, pack(range_begin(current), range_end(current) - 1)))
+        {
+            chunk = range_end(current) - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void thread_pool::execute_chunks(unsigned int worker)
+{
+    auto execute = [&](std::uint32_t chunk)
+    {
+        std::size_t const begin = chunk * chunk_size;
+        function(context, begin, std::min(begin + chunk_size, count), worker);
+    };
+
+    std::uint32_t chunk;
+
+    while (pop_front(worker, chunk))
+        execute(chunk);
+
+    for (unsigned int i = 1; i < ranges.size(); ++i)
+    {
+        unsigned int const victim = (worker + i) % ranges.size();
+        while (steal_back(victim, chunk))
+        {
+            ++steals;
+            execute(chunk);
+        }
+    }
+}
+
+void thread_pool::worker_loop(unsigned int worker)
+{
+    std::uint64_t seen_generation = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock lock(mutex);
+            wake.wait(lock, [&]{ return stop || generation != seen_generation; });
+            if (stop)
+                return;
+            seen_generation = generation;
+        }
+
+        execute_chunks(worker);
+
+        {
+            std::lock_guard lock(mutex);
+            if (--busy == 0)
+                done.notify_one();
+        }
+    }
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "body_traits.hpp"
+
 #include <glm/vec3.hpp>
 
 #include <array>
@@ -8,7 +10,29 @@ struct aabb
 {
 	aabb(glm::vec3 const & min, glm::vec3 const & max);
 
+	glm::vec3 min;
+	glm::vec3 max;
+
 	std::array<glm::vec3, 8> vertices;
 	static const std::array<glm::vec3, 3> face_normals;
 	static const std::array<glm::vec3, 3> edge_directions;
 };
+
+template <>
+struct body_traits<aabb>
+{
+	static constexpr bool axis_aligned = true;
+	static constexpr bool point_axes = false;
+
+	static std::pair<float, float> project(aabb const & b, glm::vec3 const & n)
+	{
+		float const center = glm::dot(b.max + b.min, n) * 0.5f;
+		float const radius = glm::dot(b.max - b.min, glm::abs(n)) * 0.5f;
+		return {center - radius, center + radius};
+	}
+
+	static std::pair<float, float> project_cardinal(aabb const & b, int axis)
+	{
+		return {b.min[axis], b.max[axis]};
+	}
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+template <typename T, std::size_t Alignment = 32>
+struct aligned_allocator
+{
+	using value_type = T;
+
+	template <typename U>
+	struct rebind
+	{
+		using other = aligned_allocator<U, Alignment>;
+	};
+
+	aligned_allocator() = default;
+
+	template <typename U>
+	aligned_allocator(aligned_allocator<U, Alignment> const &)
+	{}
+
+	T * allocate(std::size_t count)
+	{
+		return static_cast<T *>(::operator new(count * sizeof(T), std::align_val_t(Alignment)));
+	}
+
+	void deallocate(T * pointer, std::size_t)
+	{
+		::operator delete(pointer, std::align_val_t(Alignment));
+	}
+
+	template <typename U>
+	bool operator == (aligned_allocator<U, Alignment> const &) const
+	{
+		return true;
+	}
+};
+
+template <typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T>>;
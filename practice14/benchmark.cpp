@@ -0,0 +1,983 @@
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <atomic>
+#include <new>
+#include <limits>
+#include <algorithm>
+#include <cassert>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/matrix.hpp>
+#include <glm/geometric.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "aabb.hpp"
+#include "obb.hpp"
+#include "sphere.hpp"
+#include "frustum.hpp"
+#include "intersect.hpp"
+#include "culling.hpp"
+#include "bvh.hpp"
+#include "thread_pool.hpp"
+#include "occlusion.hpp"
+#include "spatial_hash.hpp"
+#include "triangle_bvh.hpp"
+#include "software_rasterizer.hpp"
+#include "clustered_lights.hpp"
+#include "gltf_loader.hpp"
+
+namespace
+{
+
+    std::atomic<std::size_t> allocation_count{0};
+
+    template <typename F>
+    double measure_microseconds(int iterations, F && f)
+    {
+        auto const start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            f(i);
+        auto const end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(end - start).count() / iterations;
+    }
+
+    // Same data, but projected through the generic vertex loop of body_traits
+    struct generic_aabb : aabb
+    {
+        using aabb::aabb;
+    };
+
+    struct generic_obb : obb
+    {
+        using obb::obb;
+    };
+
+    struct box
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    std::vector<box> random_boxes(std::size_t count, float extent, std::uint32_t seed)
+    {
+        std::default_random_engine rng{seed};
+        std::uniform_real_distribution<float> position{-extent, extent};
+        std::uniform_real_distribution<float> size{0.5f, 5.f};
+
+        std::vector<box> result(count);
+        for (auto & b : result)
+        {
+            b.min = {position(rng), position(rng), position(rng)};
+            b.max = b.min + glm::vec3(size(rng), size(rng), size(rng));
+        }
+        return result;
+    }
+
+    glm::mat4 camera_view_projection(float rotation)
+    {
+        glm::mat4 view(1.f);
+        view = glm::rotate(view, rotation, {0.f, 1.f, 0.f});
+        view = glm::translate(view, {0.f, 2.f, 0.f});
+
+        return glm::perspective(glm::pi<float>() / 2.f, 16.f / 9.f, 0.1f, 100.f) * view;
+    }
+
+    template <typename Body>
+    std::pair<double, std::size_t> measure_sat(std::vector<Body> const & bodies, int frames)
+    {
+        std::size_t visible = 0;
+        double const time = measure_microseconds(frames, [&](int i)
+        {
+            frustum f(camera_view_projection(i * 0.3f));
+            visible = 0;
+            for (auto const & b : bodies)
+                visible += intersect(f, b);
+        });
+        return {time, visible};
+    }
+
+    // Bounds of a transformed box, accumulating the min and max of every matrix term
+    box transform_box(glm::mat4 const & m, glm::vec3 const & min, glm::vec3 const & max)
+    {
+        box result{glm::vec3(m[3]), glm::vec3(m[3])};
+        for (int i = 0; i < 3; ++i)
+        {
+            glm::vec3 const a = glm::vec3(m[i]) * min[i];
+            glm::vec3 const b = glm::vec3(m[i]) * max[i];
+            result.min += glm::min(a, b);
+            result.max += glm::max(a, b);
+        }
+        return result;
+    }
+
+    // Pixel-exact counterpart of occlusion_culler::visible(), reading only the full resolution level
+    bool visible_in_depth_buffer(occlusion_culler const & culler, glm::mat4 const & view_projection, glm::vec3 const & min, glm::vec3 const & max)
+    {
+        glm::vec2 screen_min(std::numeric_limits<float>::infinity());
+        glm::vec2 screen_max(-std::numeric_limits<float>::infinity());
+        float nearest = 1.f;
+
+        for (int i = 0; i < 8; ++i)
+        {
+            glm::vec4 const clip = view_projection * glm::vec4((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z, 1.f);
+            if (clip.z < -clip.w || clip.w <= 0.f)
+                return true;
+
+            glm::vec3 const ndc = glm::vec3(clip) / clip.w;
+            screen_min = glm::min(screen_min, glm::vec2(ndc) * 0.5f + 0.5f);
+            screen_max = glm::max(screen_max, glm::vec2(ndc) * 0.5f + 0.5f);
+            nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+        }
+
+        int const x0 = std::max(0, int(std::floor(screen_min.x * culler.width())));
+        int const x1 = std::min(culler.width() - 1, int(std::floor(screen_max.x * culler.width())));
+        int const y0 = std::max(0, int(std::floor(screen_min.y * culler.height())));
+        int const y1 = std::min(culler.height() - 1, int(std::floor(screen_max.y * culler.height())));
+
+        for (int y = y0; y <= y1; ++y)
+            for (int x = x0; x <= x1; ++x)
+                if (nearest <= culler.depth()[y * culler.width() + x])
+                    return true;
+
+        return false;
+    }
+
+    struct instance
+    {
+        glm::mat4 model;
+        box bounds;
+    };
+
+    // Randomly rotated and scaled bunnies on the ground plane, spacing units apart on average
+    std::vector<instance> scatter_instances(std::size_t count, glm::vec3 const & min, glm::vec3 const & max, float spacing, std::uint32_t seed)
+    {
+        float const extent = 0.5f * spacing * std::sqrt(float(count));
+
+        std::default_random_engine rng{seed};
+        std::uniform_real_distribution<float> position{-extent, extent};
+        std::uniform_real_distribution<float> angle{0.f, 2.f * glm::pi<float>()};
+        std::uniform_real_distribution<float> scale{0.5f, 2.f};
+
+        std::vector<instance> result(count);
+        for (auto & i : result)
+        {
+            i.model = glm::translate(glm::mat4(1.f), {position(rng), 0.f, position(rng)});
+            i.model = glm::rotate(i.model, angle(rng), {0.f, 1.f, 0.f});
+            i.model = glm::scale(i.model, glm::vec3(scale(rng)));
+            i.bounds = transform_box(i.model, min, max);
+        }
+        return result;
+    }
+
+}
+
+// Counts heap allocations, to check that spatial index updates do not allocate
+void * operator new(std::size_t size)
+{
+    ++allocation_count;
+    if (void * result = std::malloc(size))
+        return result;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void * pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+int main() try
+{
+    std::size_t const box_count = 100000;
+    int const frames = 20;
+
+    auto const boxes = random_boxes(box_count, 150.f, 42);
+
+    std::size_t checksum = 0;
+
+    // Plane-based culling against the full SAT test
+    {
+        std::vector<aabb> sat_boxes;
+        aabb_soa soa_boxes;
+        for (auto const & b : boxes)
+        {
+            sat_boxes.emplace_back(b.min, b.max);
+            soa_boxes.push_back(b.min, b.max);
+        }
+
+        std::vector<char> sat_visible(box_count);
+        std::vector<cull_result> results(box_count);
+
+        double const sat_time = measure_microseconds(frames, [&](int i)
+        {
+            frustum f(camera_view_projection(i * 0.3f));
+            for (std::size_t j = 0; j < box_count; ++j)
+                sat_visible[j] = intersect(f, sat_boxes[j]);
+            checksum += sat_visible[i];
+        });
+
+        double const scalar_time = measure_microseconds(frames, [&](int i)
+        {
+            frustum f(camera_view_projection(i * 0.3f));
+            for (std::size_t j = 0; j < box_count; ++j)
+                results[j] = classify(f, boxes[j].min, boxes[j].max);
+            checksum += static_cast<std::size_t>(results[i]);
+        });
+
+        double const batch_time = measure_microseconds(frames, [&](int i)
+        {
+            frustum f(camera_view_projection(i * 0.3f));
+            classify(f, soa_boxes, results.data());
+            checksum += static_cast<std::size_t>(results[i]);
+        });
+
+        // Compare the last frame: planes must only reject what SAT rejects
+        std::size_t visible = 0, inside = 0, false_positives = 0, false_negatives = 0;
+        for (std::size_t j = 0; j < box_count; ++j)
+        {
+            bool const plane_visible = results[j] != cull_result::outside;
+            visible += sat_visible[j];
+            inside += results[j] == cull_result::inside;
+            false_positives += plane_visible && !sat_visible[j];
+            false_negatives += !plane_visible && sat_visible[j];
+        }
+
+#ifdef __AVX__
+        char const * batch_name = "AVX";
+#else
+        char const * batch_name = "scalar fallback";
+#endif
+
+        std::cout << "Frustum culling of " << box_count << " boxes:" << std::endl;
+        std::cout << "    SAT: " << sat_time / 1000.0 << " ms" << std::endl;
+        std::cout << "    Planes, scalar: " << scalar_time / 1000.0 << " ms" << std::endl;
+        std::cout << "    Planes, SoA batches of 8 (" << batch_name << "): " << batch_time / 1000.0 << " ms, "
+            << (sat_time / batch_time) << "x faster than SAT" << std::endl;
+        std::cout << "    " << visible << " visible by SAT, " << inside << " fully inside, "
+            << false_positives << " conservative extra, " << false_negatives << " culled by planes only" << std::endl;
+    }
+
+    // SAT with the last separating axis cached per object, under a slowly turning camera
+    {
+        std::vector<aabb> sat_boxes;
+        for (auto const & b : boxes)
+            sat_boxes.emplace_back(b.min, b.max);
+
+        auto camera = [](int frame){ return camera_view_projection(frame * 0.01f); };
+
+        std::vector<char> expected(box_count), result(box_count);
+        double const plain_time = measure_microseconds(frames, [&](int i)
+        {
+            frustum f(camera(i));
+            for (std::size_t j = 0; j < box_count; ++j)
+                expected[j] = intersect(f, sat_boxes[j]);
+        });
+
+        // Resetting the caches every frame gives the axis count of the plain test
+        separating_axis_stats cold;
+        for (int i = 0; i < frames; ++i)
+        {
+            frustum f(camera(i));
+            for (std::size_t j = 0; j < box_count; ++j)
+            {
+                separating_axis_cache cache;
+                intersect(f, sat_boxes[j], cache, &cold);
+            }
+        }
+
+        std::vector<separating_axis_cache> caches(box_count);
+        for (std::size_t j = 0; j < box_count; ++j)
+            intersect(frustum(camera(-1)), sat_boxes[j], caches[j]);
+
+        separating_axis_stats warm;
+        double const cached_time = measure_microseconds(frames, [&](int i)
+        {
+            frustum f(camera(i));
+            for (std::size_t j = 0; j < box_count; ++j)
+                result[j] = intersect(f, sat_boxes[j], caches[j], &warm);
+        });
+
+        std::cout << "SAT with separating axis cache, " << box_count << " boxes:" << std::endl;
+        std::cout << "    Plain: " << plain_time / 1000.0 << " ms, " << cold.axes_per_test() << " axes per box" << std::endl;
+        std::cout << "    Cached: " << cached_time / 1000.0 << " ms, " << warm.axes_per_test() << " axes per box, "
+            << 100.f * warm.early_out_rate() << "% of rejections by the cached axis, "
+            << (result == expected ? "same" : "DIFFERENT") << " result" << std::endl;
+        checksum += warm.cache_hits;
+    }
+
+    // Closed-form projections picked at compile time against the generic vertex loop
+    {
+        std::default_random_engine rng{5};
+        std::uniform_real_distribution<float> unit{-1.f, 1.f};
+
+        std::vector<aabb> aabbs;
+        std::vector<generic_aabb> generic_aabbs;
+        std::vector<obb> obbs;
+        std::vector<generic_obb> generic_obbs;
+        std::vector<sphere> spheres;
+        for (auto const & b : boxes)
+        {
+            aabbs.emplace_back(b.min, b.max);
+            generic_aabbs.emplace_back(b.min, b.max);
+
+            glm::vec3 const center = (b.min + b.max) * 0.5f;
+            glm::vec3 const extents = (b.max - b.min) * 0.5f;
+            glm::mat3 const axes = glm::mat3_cast(glm::normalize(glm::quat(unit(rng), unit(rng), unit(rng), unit(rng))));
+            obbs.emplace_back(center, axes, extents);
+            generic_obbs.emplace_back(center, axes, extents);
+            spheres.emplace_back(center, glm::length(extents));
+        }
+
+        auto const [aabb_time, aabb_visible] = measure_sat(aabbs, frames);
+        auto const [generic_aabb_time, generic_aabb_visible] = measure_sat(generic_aabbs, frames);
+        auto const [obb_time, obb_visible] = measure_sat(obbs, frames);
+        auto const [generic_obb_time, generic_obb_visible] = measure_sat(generic_obbs, frames);
+        auto const [sphere_time, sphere_visible] = measure_sat(spheres, frames);
+
+        std::cout << "SAT against the frustum with body traits, " << box_count << " bodies:" << std::endl;
+        std::cout << "    aabb: " << aabb_time / 1000.0 << " ms, generic " << generic_aabb_time / 1000.0 << " ms ("
+            << aabb_visible << " and " << generic_aabb_visible << " visible)" << std::endl;
+        std::cout << "    obb: " << obb_time / 1000.0 << " ms, generic " << generic_obb_time / 1000.0 << " ms ("
+            << obb_visible << " and " << generic_obb_visible << " visible)" << std::endl;
+        std::cout << "    sphere: " << sphere_time / 1000.0 << " ms (" << sphere_visible << " visible)" << std::endl;
+        checksum += aabb_visible + obb_visible + sphere_visible;
+    }
+
+    // One pass over the boxes for the camera and the shadow views
+    {
+        std::vector<frustum> views;
+        views.emplace_back(camera_view_projection(0.f));
+        views.emplace_back(camera_view_projection(glm::pi<float>()));
+        for (int i = 0; i < 4; ++i)
+        {
+            // Cascade-like light views growing around the camera
+            float const size = 25.f * (1 << i);
+            glm::mat4 const light_view = glm::lookAt(glm::vec3(0.f), -glm::normalize(glm::vec3(1.f, 2.f, 3.f)), {0.f, 1.f, 0.f});
+            views.emplace_back(glm::ortho(-size, size, -size, size, -200.f, 200.f) * light_view);
+        }
+
+        aabb_soa soa_boxes;
+        for (auto const & b : boxes)
+            soa_boxes.push_back(b.min, b.max);
+
+        std::vector<cull_result> results(box_count);
+        std::vector<std::vector<std::uint32_t>> expected(views.size());
+
+        double const separate_time = measure_microseconds(frames, [&](int)
+        {
+            for (std::size_t v = 0; v < views.size(); ++v)
+            {
+                classify(views[v], soa_boxes, results.data());
+                expected[v].clear();
+                for (std::size_t i = 0; i < box_count; ++i)
+                    if (results[i] != cull_result::outside)
+                        expected[v].push_back(i);
+            }
+            checksum += expected[0].size();
+        });
+
+        std::cout << "Culling " << box_count << " boxes against " << views.size() << " views:" << std::endl;
+        std::cout << "    Separate passes: " << separate_time / 1000.0 << " ms" << std::endl;
+
+        for (unsigned int threads : {1u, 2u, 4u, 8u})
+        {
+            thread_pool pool(threads);
+            multi_view_culling culling;
+
+            double const time = measure_microseconds(frames, [&](int)
+            {
+                cull_views(pool, views.data(), views.size(), soa_boxes, culling);
+                checksum += culling.visible[0].size();
+            });
+
+            std::cout << "    Single pass, " << threads << " threads: " << time / 1000.0 << " ms, "
+                << (culling.visible == expected ? "same" : "DIFFERENT") << " lists (";
+            for (std::size_t v = 0; v < views.size(); ++v)
+                std::cout << (v ? ", " : "") << culling.visible[v].size();
+            std::cout << " visible)" << std::endl;
+        }
+    }
+
+    // Hierarchical culling of instanced bunnies
+    {
+        const std::string project_root = PROJECT_ROOT;
+        auto const model = load_gltf(project_root + "/bunny/bunny.gltf");
+        auto const & mesh = model.meshes[0];
+
+        std::cout << "BVH culling of bunny instances:" << std::endl;
+
+        for (std::size_t count : {10000, 100000, 1000000})
+        {
+            auto const instances = scatter_instances(count, mesh.min, mesh.max, 6.f, 7);
+
+            std::vector<glm::vec3> min(count), max(count);
+            aabb_soa soa_boxes;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                min[i] = instances[i].bounds.min;
+                max[i] = instances[i].bounds.max;
+                soa_boxes.push_back(min[i], max[i]);
+            }
+
+            bvh tree;
+            double const build_time = measure_microseconds(1, [&](int)
+            {
+                tree.build(min.data(), max.data(), count);
+            });
+
+            std::vector<cull_result> results(count);
+            double const brute_time = measure_microseconds(frames, [&](int i)
+            {
+                classify(frustum(camera_view_projection(i * 0.3f)), soa_boxes, results.data());
+                checksum += static_cast<std::size_t>(results[i]);
+            });
+
+            std::vector<std::uint32_t> visible;
+            std::size_t tested = 0;
+            double const bvh_time = measure_microseconds(frames, [&](int i)
+            {
+                visible.clear();
+                tested = tree.cull(frustum(camera_view_projection(i * 0.3f)), visible);
+                checksum += visible.size();
+            });
+
+            std::vector<std::uint32_t> expected;
+            for (std::size_t i = 0; i < count; ++i)
+                if (results[i] != cull_result::outside)
+                    expected.push_back(i);
+            std::sort(visible.begin(), visible.end());
+            bool const same = visible == expected;
+
+            // Every bunny wanders a little, which only loosens the tree
+            std::default_random_engine rng{13};
+            std::uniform_real_distribution<float> offset{-1.f, 1.f};
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                glm::vec3 const d(offset(rng), 0.f, offset(rng));
+                min[i] += d;
+                max[i] += d;
+            }
+
+            double const refit_time = measure_microseconds(1, [&](int)
+            {
+                tree.refit(min.data(), max.data());
+            });
+
+            double const refit_cull_time = measure_microseconds(frames, [&](int i)
+            {
+                visible.clear();
+                tree.cull(frustum(camera_view_projection(i * 0.3f)), visible);
+                checksum += visible.size();
+            });
+
+            std::cout << "    " << count << " objects, " << expected.size() << " visible: brute force " << brute_time / 1000.0
+                << " ms, BVH " << bvh_time / 1000.0 << " ms (" << tested << " boxes tested, "
+                << (same ? "same" : "DIFFERENT") << " result), build " << build_time / 1000.0
+                << " ms, refit " << refit_time / 1000.0 << " ms, cull after refit " << refit_cull_time / 1000.0 << " ms" << std::endl;
+        }
+    }
+
+    // Moving particles in a loose hashed grid
+    {
+        std::size_t const count = 100000;
+        float const extent = 100.f;
+
+        std::default_random_engine rng{17};
+        std::uniform_real_distribution<float> position{-extent, extent};
+        std::uniform_real_distribution<float> velocity{-5.f, 5.f};
+        std::uniform_real_distribution<float> size{0.1f, 0.5f};
+
+        struct particle
+        {
+            glm::vec3 position;
+            glm::vec3 velocity;
+            float radius;
+            spatial_hash::handle handle;
+        };
+
+        spatial_hash index(2.f, count, count);
+        std::vector<particle> particles(count);
+        for (auto & p : particles)
+        {
+            p.position = {position(rng), position(rng), position(rng)};
+            p.velocity = {velocity(rng), velocity(rng), velocity(rng)};
+            p.radius = size(rng);
+            p.handle = index.insert(p.position - p.radius, p.position + p.radius);
+        }
+
+        float const dt = 0.016f;
+        std::size_t const allocations_before = allocation_count;
+        double const move_time = measure_microseconds(frames, [&](int)
+        {
+            for (auto & p : particles)
+            {
+                p.position += p.velocity * dt;
+                for (int k = 0; k < 3; ++k)
+                    if (std::abs(p.position[k]) > extent)
+                        p.velocity[k] = -p.velocity[k];
+                index.move(p.handle, p.position - p.radius, p.position + p.radius);
+            }
+        });
+
+        // Remove and reinsert a tenth of the particles, which reuses the freed slots
+        double const churn_time = measure_microseconds(1, [&](int)
+        {
+            for (std::size_t i = 0; i < count; i += 10)
+            {
+                auto & p = particles[i];
+                index.remove(p.handle);
+                p.handle = index.insert(p.position - p.radius, p.position + p.radius);
+            }
+        });
+        std::size_t const update_allocations = allocation_count - allocations_before;
+
+        auto brute_force = [&](auto && test)
+        {
+            std::size_t result = 0;
+            for (auto const & p : particles)
+                result += test(index.min(p.handle), index.max(p.handle));
+            return result;
+        };
+
+        int const queries = 1000;
+        std::size_t sphere_found = 0, sphere_mismatches = 0, box_found = 0, box_mismatches = 0;
+
+        double const sphere_time = measure_microseconds(queries, [&](int i)
+        {
+            sphere const s({position(rng), position(rng), position(rng)}, 5.f);
+            index.query(s, [&](spatial_hash::handle){ ++sphere_found; });
+            if (i % 100 == 0)
+            {
+                std::size_t found = 0;
+                index.query(s, [&](spatial_hash::handle){ ++found; });
+                sphere_mismatches += found != brute_force([&](glm::vec3 const & min, glm::vec3 const & max)
+                {
+                    glm::vec3 const d = s.center - glm::clamp(s.center, min, max);
+                    return glm::dot(d, d) <= s.radius * s.radius;
+                });
+            }
+        });
+
+        double const box_time = measure_microseconds(queries, [&](int i)
+        {
+            glm::vec3 const corner(position(rng), position(rng), position(rng));
+            aabb const box(corner, corner + 10.f);
+            index.query(box, [&](spatial_hash::handle){ ++box_found; });
+            if (i % 100 == 0)
+            {
+                std::size_t found = 0;
+                index.query(box, [&](spatial_hash::handle){ ++found; });
+                box_mismatches += found != brute_force([&](glm::vec3 const & min, glm::vec3 const & max)
+                {
+                    return glm::all(glm::lessThanEqual(min, box.max)) && glm::all(glm::lessThanEqual(box.min, max));
+                });
+            }
+        });
+
+        frustum const near_view(glm::perspective(glm::pi<float>() / 2.f, 16.f / 9.f, 0.1f, 30.f));
+        std::size_t frustum_found = 0;
+        double const frustum_time = measure_microseconds(frames, [&](int)
+        {
+            frustum_found = 0;
+            index.query(near_view, [&](spatial_hash::handle){ ++frustum_found; });
+        });
+        std::size_t const frustum_expected = brute_force([&](glm::vec3 const & min, glm::vec3 const & max)
+        {
+            return classify(near_view, min, max) != cull_result::outside;
+        });
+
+        std::cout << "Loose hashed grid with " << count << " moving particles:" << std::endl;
+        std::cout << "    Move: " << 1000.0 * move_time / count << " ns per particle, remove and insert "
+            << 1000.0 * churn_time / (count / 10) << " ns, " << update_allocations << " allocations" << std::endl;
+        std::cout << "    Sphere query: " << sphere_time << " us, " << double(sphere_found) / queries << " found, "
+            << sphere_mismatches << " of " << queries / 100 << " checked queries differ from brute force" << std::endl;
+        std::cout << "    Box query: " << box_time << " us, " << double(box_found) / queries << " found, "
+            << box_mismatches << " of " << queries / 100 << " checked queries differ from brute force" << std::endl;
+        std::cout << "    Frustum query: " << frustum_time / 1000.0 << " ms, " << frustum_found << " found, brute force "
+            << frustum_expected << std::endl;
+        checksum += sphere_found + box_found;
+    }
+
+    // Occlusion culling in a dense field of bunnies, seen from the ground
+    {
+        const std::string project_root = PROJECT_ROOT;
+        auto const model = load_gltf(project_root + "/bunny/bunny.gltf");
+
+        // The coarsest level of detail serves as the occluder mesh
+        auto const & lod = model.meshes.back();
+        assert(lod.indices.type == 0x1403); // GL_UNSIGNED_SHORT
+        occluder_mesh const occluder(
+            reinterpret_cast<glm::vec3 const *>(model.buffer.data() + lod.position.view.offset),
+            reinterpret_cast<std::uint16_t const *>(model.buffer.data() + lod.indices.view.offset),
+            lod.indices.count);
+
+        std::size_t const count = 100000;
+        // Occluder budget per frame, which bounds the rasterization time
+        std::size_t const max_occluders = 256;
+
+        auto const instances = scatter_instances(count, model.meshes[0].min, model.meshes[0].max, 2.f, 11);
+        std::vector<glm::vec3> min(count), max(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            min[i] = instances[i].bounds.min;
+            max[i] = instances[i].bounds.max;
+        }
+
+        bvh tree;
+        tree.build(min.data(), max.data(), count);
+
+        thread_pool pool(4);
+        occlusion_culler culler(256, 128);
+        occlusion_culler reference(1024, 512);
+
+        std::vector<std::uint32_t> frustum_visible;
+        std::vector<std::uint32_t> occluders;
+        std::vector<glm::vec3> candidate_min, candidate_max;
+        std::vector<std::uint8_t> visible, reference_visible;
+
+        double frustum_time = 0.0, render_time = 0.0, test_time = 0.0;
+        std::size_t frustum_total = 0, visible_total = 0, wrongly_culled = 0;
+
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            glm::vec3 const eye(0.f, 0.4f, 0.f);
+            float const rotation = frame * 0.3f;
+            glm::mat4 const view = glm::translate(glm::rotate(glm::mat4(1.f), rotation, {0.f, 1.f, 0.f}), -eye);
+            glm::mat4 const view_projection = glm::perspective(glm::pi<float>() / 2.f, 2.f, 0.1f, 100.f) * view;
+
+            frustum_time += measure_microseconds(1, [&](int)
+            {
+                frustum_visible.clear();
+                tree.cull(frustum(view_projection), frustum_visible);
+            });
+
+            render_time += measure_microseconds(1, [&](int)
+            {
+                // Nearest objects make the best occluders for their cost
+                auto distance = [&](std::uint32_t i){ return glm::length(glm::vec3(instances[i].model[3]) - eye); };
+                occluders = frustum_visible;
+                std::size_t const occluder_count = std::min(max_occluders, occluders.size());
+                std::partial_sort(occluders.begin(), occluders.begin() + occluder_count, occluders.end(),
+                    [&](std::uint32_t a, std::uint32_t b){ return distance(a) < distance(b); });
+
+                culler.begin(view_projection);
+                for (std::size_t i = 0; i < occluder_count; ++i)
+                    culler.add_occluder(instances[occluders[i]].model, occluder);
+                culler.render(pool);
+            });
+
+            candidate_min.clear();
+            candidate_max.clear();
+            for (auto i : frustum_visible)
+            {
+                candidate_min.push_back(min[i]);
+                candidate_max.push_back(max[i]);
+            }
+            visible.resize(frustum_visible.size());
+
+            test_time += measure_microseconds(1, [&](int)
+            {
+                culler.test(pool, candidate_min.data(), candidate_max.data(), frustum_visible.size(), visible.data());
+            });
+
+            // Objects found hidden must also be hidden at four times the resolution with every object as an occluder,
+            // tested pixel by pixel, since every pixel of the coarse buffer bounds the depths of the finer ones it spans
+            reference.begin(view_projection);
+            for (auto i : frustum_visible)
+                reference.add_occluder(instances[i].model, occluder);
+            reference.render(pool);
+            reference_visible.resize(frustum_visible.size());
+            for (std::size_t i = 0; i < frustum_visible.size(); ++i)
+                reference_visible[i] = visible_in_depth_buffer(reference, view_projection, candidate_min[i], candidate_max[i]);
+
+            frustum_total += frustum_visible.size();
+            for (std::size_t i = 0; i < visible.size(); ++i)
+            {
+                visible_total += visible[i];
+                wrongly_culled += !visible[i] && reference_visible[i];
+            }
+            checksum += culler.triangle_count();
+        }
+
+        std::cout << "Occlusion culling of " << count << " bunnies, " << culler.width() << "x" << culler.height() << " depth buffer, "
+            << max_occluders << " occluders of " << occluder.triangle_count() << " triangles, " << pool.thread_count() << " threads:" << std::endl;
+        std::cout << "    " << frustum_total / frames << " objects in the frustum, " << visible_total / frames << " not occluded ("
+            << 100.0 * (frustum_total - visible_total) / frustum_total << "% culled), " << wrongly_culled << " hidden objects visible in the "
+            << reference.width() << "x" << reference.height() << " reference" << std::endl;
+        std::cout << "    Frustum " << frustum_time / frames / 1000.0 << " ms, occluders " << render_time / frames / 1000.0
+            << " ms, tests " << test_time / frames / 1000.0 << " ms" << std::endl;
+
+        if (wrongly_culled != 0)
+            throw std::runtime_error("Occlusion culling hid objects that are visible in the reference");
+    }
+
+    // Ray queries against the full resolution bunny, e.g. for picking
+    {
+        const std::string project_root = PROJECT_ROOT;
+        auto const model = load_gltf(project_root + "/bunny/bunny.gltf");
+
+        auto const & mesh = model.meshes[0];
+        assert(mesh.indices.type == 0x1403); // GL_UNSIGNED_SHORT
+        auto const positions = reinterpret_cast<glm::vec3 const *>(model.buffer.data() + mesh.position.view.offset);
+        auto const indices = reinterpret_cast<std::uint16_t const *>(model.buffer.data() + mesh.indices.view.offset);
+        std::size_t const triangle_count = mesh.indices.count / 3;
+
+        std::cout << "Ray queries against a bunny of " << triangle_count << " triangles:" << std::endl;
+
+        for (unsigned int threads : {1u, 4u})
+        {
+            thread_pool pool(threads);
+            std::size_t node_count = 0;
+            double const time = measure_microseconds(frames, [&](int)
+            {
+                triangle_bvh const tree(pool, positions, indices, mesh.indices.count);
+                node_count = tree.nodes.size();
+            });
+            std::cout << "    Build, " << threads << " threads: " << time / 1000.0 << " ms, " << node_count << " nodes" << std::endl;
+        }
+
+        thread_pool pool(4);
+        triangle_bvh const tree(pool, positions, indices, mesh.indices.count);
+
+        // Rays from a sphere around the bunny towards random points of its bounds, so that most of them hit
+        glm::vec3 const center = (mesh.min + mesh.max) * 0.5f;
+        float const radius = glm::length(mesh.max - mesh.min);
+
+        std::size_t const ray_count = 1000000;
+        std::vector<ray> rays(ray_count);
+        std::default_random_engine rng{5};
+        std::normal_distribution<float> normal;
+        std::uniform_real_distribution<float> uniform;
+        for (auto & r : rays)
+        {
+            r.origin = center + radius * glm::normalize(glm::vec3(normal(rng), normal(rng), normal(rng)));
+            glm::vec3 const target = glm::mix(mesh.min, mesh.max, glm::vec3(uniform(rng), uniform(rng), uniform(rng)));
+            r.direction = target - r.origin;
+        }
+
+        std::size_t hits = 0;
+        double const closest_time = measure_microseconds(1, [&](int)
+        {
+            for (auto const & r : rays)
+                hits += tree.closest_hit(r).has_value();
+        });
+
+        std::size_t any_hits = 0;
+        double const any_time = measure_microseconds(1, [&](int)
+        {
+            for (auto const & r : rays)
+                any_hits += tree.any_hit(r);
+        });
+
+        std::atomic<std::size_t> parallel_hits{0};
+        double const parallel_time = measure_microseconds(1, [&](int)
+        {
+            pool.parallel_for(ray_count, 4096, [&](std::size_t begin, std::size_t end)
+            {
+                std::size_t local_hits = 0;
+                for (std::size_t i = begin; i < end; ++i)
+                    local_hits += tree.closest_hit(rays[i]).has_value();
+                parallel_hits += local_hits;
+            });
+        });
+
+        // Brute force over every triangle for a subset of the rays
+        std::size_t const checked = 1000;
+        std::size_t mismatches = 0;
+        for (std::size_t i = 0; i < checked; ++i)
+        {
+            ray const & r = rays[i * (ray_count / checked)];
+            float expected = std::numeric_limits<float>::infinity();
+            for (std::size_t t = 0; t < triangle_count; ++t)
+            {
+                glm::vec3 const v0 = positions[indices[3 * t]];
+                glm::vec3 const e1 = positions[indices[3 * t + 1]] - v0;
+                glm::vec3 const e2 = positions[indices[3 * t + 2]] - v0;
+                glm::vec3 const p = glm::cross(r.direction, e2);
+                glm::vec3 const s = r.origin - v0;
+                glm::vec3 const q = glm::cross(s, e1);
+                float const det = glm::dot(e1, p);
+                float const u = glm::dot(s, p) / det;
+                float const v = glm::dot(r.direction, q) / det;
+                float const d = glm::dot(e2, q) / det;
+                if (u >= 0.f && v >= 0.f && u + v <= 1.f && d >= 0.f)
+                    expected = std::min(expected, d);
+            }
+
+            auto const hit = tree.closest_hit(r);
+            bool const same = hit ? std::abs(hit->t - expected) <= 1e-4f * expected : std::isinf(expected);
+            mismatches += !same || (hit.has_value() != tree.any_hit(r));
+        }
+
+        std::cout << "    Closest hit: " << ray_count / closest_time << " Mrays/s, " << 100.0 * hits / ray_count << "% hit" << std::endl;
+        std::cout << "    Any hit: " << ray_count / any_time << " Mrays/s, " << 100.0 * any_hits / ray_count << "% hit" << std::endl;
+        std::cout << "    Closest hit, " << pool.thread_count() << " threads: " << ray_count / parallel_time << " Mrays/s" << std::endl;
+        std::cout << "    " << mismatches << " of " << checked << " rays differ from brute force" << std::endl;
+        checksum += hits + any_hits + parallel_hits;
+    }
+
+    // Software rasterization of a field of bunnies, partly crossing the near plane
+    {
+        const std::string project_root = PROJECT_ROOT;
+        auto const model = load_gltf(project_root + "/bunny/bunny.gltf");
+        raster_mesh const mesh(model, model.meshes[0]);
+
+        std::size_t const count = 400;
+        auto const instances = scatter_instances(count, model.meshes[0].min, model.meshes[0].max, 1.f, 17);
+
+        int const width = 1280, height = 720;
+        glm::mat4 const view = glm::lookAt(glm::vec3(0.f, 0.3f, 0.f), glm::vec3(5.f, 0.f, 5.f), glm::vec3(0.f, 1.f, 0.f));
+        glm::mat4 const projection = glm::perspective(glm::pi<float>() / 2.f, float(width) / height, 0.05f, 100.f);
+
+        std::cout << "Software rasterization of " << count << " bunnies (" << count * mesh.triangle_count() << " triangles) at "
+            << width << "x" << height << ":" << std::endl;
+
+        std::vector<std::uint32_t> first_image;
+        for (unsigned int threads : {1u, 4u})
+        {
+            thread_pool pool(threads);
+            software_rasterizer rasterizer(width, height);
+
+            for (shading_model model : {shading_model::hemisphere, shading_model::phong})
+            {
+                lighting light;
+                light.model = model;
+
+                double const time = measure_microseconds(frames, [&](int)
+                {
+                    rasterizer.begin(view, projection, {0.8f, 0.8f, 0.9f});
+                    for (auto const & i : instances)
+                        rasterizer.draw(i.model, mesh);
+                    rasterizer.render(pool, light);
+                });
+
+                bool same = true;
+                if (model == shading_model::phong)
+                {
+                    if (first_image.empty())
+                        first_image = rasterizer.color();
+                    same = (rasterizer.color() == first_image);
+                }
+
+                std::cout << "    " << (model == shading_model::phong ? "Phong" : "Hemisphere") << ", " << threads << " threads: "
+                    << time / 1000.0 << " ms, " << rasterizer.triangle_count() << " triangles drawn"
+                    << (same ? "" : ", image DIFFERS from 1 thread") << std::endl;
+
+                for (auto pixel : rasterizer.color())
+                    checksum += pixel & 0xff;
+            }
+        }
+    }
+
+    // Clustered assignment of point lights scattered around a moving camera
+    {
+        std::size_t const count = 4096;
+        float const extent = 50.f;
+
+        std::default_random_engine rng{23};
+        std::uniform_real_distribution<float> position{-extent, extent};
+        std::uniform_real_distribution<float> height{0.f, 10.f};
+        std::uniform_real_distribution<float> radius{0.5f, 4.f};
+
+        std::vector<point_light> lights(count);
+        for (auto & l : lights)
+        {
+            l.position = {position(rng), height(rng), position(rng)};
+            l.radius = radius(rng);
+            l.color = glm::vec3(1.f);
+        }
+
+        int const tiles_x = 16, tiles_y = 9, slices = 24;
+        float const fov_y = glm::pi<float>() / 3.f, aspect = 16.f / 9.f;
+        auto camera = [](int i)
+        {
+            glm::mat4 view(1.f);
+            view = glm::rotate(view, 0.1f * i, {0.f, 1.f, 0.f});
+            return glm::translate(view, {0.f, -2.f, 0.f});
+        };
+
+        std::cout << "Clustered assignment of " << count << " point lights, " << tiles_x << "x" << tiles_y << "x" << slices << " clusters:" << std::endl;
+
+        std::vector<std::uint32_t> first_indices;
+        for (unsigned int threads : {1u, 4u})
+        {
+            thread_pool pool(threads);
+            light_clusters clusters(tiles_x, tiles_y, slices);
+            clusters.set_projection(fov_y, aspect, 0.1f, 100.f);
+
+            // Warm up so that the per-cluster lists reach their capacity before allocations are counted
+            for (int i = 0; i < frames; ++i)
+                clusters.assign(pool, camera(i), lights.data(), count);
+
+            std::size_t const allocations_before = allocation_count;
+            double const time = measure_microseconds(frames, [&](int i)
+            {
+                clusters.assign(pool, camera(i), lights.data(), count);
+            });
+            std::size_t const allocations = allocation_count - allocations_before;
+
+            // Every light containing a point inside the frustum must be listed by the point's cluster
+            std::default_random_engine sample_rng{29};
+            std::uniform_real_distribution<float> unit{-1.f, 1.f};
+            std::uniform_real_distribution<float> depth{0.1f, 100.f};
+            glm::mat4 const view = camera(frames - 1);
+            glm::mat4 const inverse_view = glm::inverse(view);
+            std::size_t missing = 0;
+            for (int s = 0; s < 2000; ++s)
+            {
+                float const d = depth(sample_rng);
+                glm::vec3 const p(unit(sample_rng) * d * std::tan(fov_y / 2.f) * aspect, unit(sample_rng) * d * std::tan(fov_y / 2.f), -d);
+                int const c = clusters.cluster_of(p);
+                if (c < 0)
+                    continue;
+
+                glm::vec3 const world(inverse_view * glm::vec4(p, 1.f));
+                auto const begin = clusters.light_indices().begin() + clusters.offsets()[c];
+                auto const end = begin + clusters.counts()[c];
+                for (std::size_t l = 0; l < count; ++l)
+                    if (glm::length(world - lights[l].position) < 0.999f * lights[l].radius && !std::binary_search(begin, end, l))
+                        ++missing;
+            }
+
+            std::uint32_t max_count = 0;
+            std::size_t lit = 0;
+            for (auto n : clusters.counts())
+            {
+                max_count = std::max(max_count, n);
+                lit += (n > 0);
+            }
+
+            if (first_indices.empty())
+                first_indices = clusters.light_indices();
+
+            std::cout << "    " << threads << " threads: " << time / 1000.0 << " ms, " << clusters.light_indices().size() << " indices, "
+                << double(clusters.light_indices().size()) / std::max<std::size_t>(lit, 1) << " lights per lit cluster (max " << max_count << "), "
+                << lit << " of " << clusters.cluster_count() << " clusters lit, " << allocations << " allocations, "
+                << missing << " missing" << (clusters.light_indices() == first_indices ? "" : ", indices DIFFER from 1 thread") << std::endl;
+
+            checksum += clusters.light_indices().size();
+        }
+    }
+
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+// How SAT projects a body onto an axis. The default walks the vertices; bodies with
+// a cheaper closed form specialize it next to their definition
+template <typename Body>
+struct body_traits
+{
+	// Face normals are the unit x, y and z axes, in this order
+	static constexpr bool axis_aligned = false;
+	// Curved bodies: the axes from center(b) to every vertex of the other body are tested as well
+	static constexpr bool point_axes = false;
+
+	static std::pair<float, float> project(Body const & b, glm::vec3 const & n)
+	{
+		static constexpr float inf = std::numeric_limits<float>::infinity();
+
+		float min = inf;
+		float max = -inf;
+
+		for (auto const & p : b.vertices)
+		{
+			float v = glm::dot(p, n);
+			min = std::min(min, v);
+			max = std::max(max, v);
+		}
+
+		return {min, max};
+	}
+
+	// Projection onto the unit axis with the given index, without dot products
+	static std::pair<float, float> project_cardinal(Body const & b, int axis)
+	{
+		static constexpr float inf = std::numeric_limits<float>::infinity();
+
+		float min = inf;
+		float max = -inf;
+
+		for (auto const & p : b.vertices)
+		{
+			min = std::min(min, p[axis]);
+			max = std::max(max, p[axis]);
+		}
+
+		return {min, max};
+	}
+};
@@ -0,0 +1,235 @@
+#include "bvh.hpp"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+
+	constexpr std::size_t bin_count = 16;
+	constexpr std::uint32_t max_leaf_size = 4;
+	// Larger leaves are only made when splitting is not worth it by SAH
+	constexpr std::uint32_t max_sah_leaf_size = 16;
+	// Keeps the traversal stack bounded for degenerate inputs
+	constexpr std::size_t max_depth = 60;
+	// Cost of visiting a node relative to testing one object box
+	constexpr float traversal_cost = 1.f;
+
+	constexpr float inf = std::numeric_limits<float>::infinity();
+
+	struct box
+	{
+		glm::vec3 min{inf};
+		glm::vec3 max{-inf};
+
+		void extend(glm::vec3 const & p_min, glm::vec3 const & p_max)
+		{
+			min = glm::min(min, p_min);
+			max = glm::max(max, p_max);
+		}
+
+		float area() const
+		{
+			glm::vec3 const d = glm::max(max - min, glm::vec3(0.f));
+			return d.x * d.y + d.y * d.z + d.z * d.x;
+		}
+	};
+
+	struct builder
+	{
+		bvh & tree;
+		glm::vec3 const * min;
+		glm::vec3 const * max;
+		std::vector<glm::vec3> centroids;
+
+		std::uint32_t build(std::uint32_t begin, std::uint32_t end, std::size_t depth)
+		{
+			box bounds, centroid_bounds;
+			for (std::uint32_t i = begin; i < end; ++i)
+			{
+				std::uint32_t const o = tree.objects[i];
+				bounds.extend(min[o], max[o]);
+				centroid_bounds.extend(centroids[o], centroids[o]);
+			}
+
+			std::uint32_t const index = tree.nodes.size();
+			tree.nodes.push_back({bounds.min, begin, bounds.max, end - begin, 0});
+
+			if (end - begin <= max_leaf_size || depth == max_depth)
+				return index;
+
+			glm::vec3 const extent = centroid_bounds.max - centroid_bounds.min;
+			int const axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z) ? 1 : 2;
+			if (extent[axis] <= 0.f)
+				return index;
+
+			float const scale = bin_count / extent[axis];
+			auto bin_of = [&](std::uint32_t o)
+			{
+				return std::min<std::size_t>(bin_count - 1, (centroids[o][axis] - centroid_bounds.min[axis]) * scale);
+			};
+
+			std::array<box, bin_count> bins;
+			std::array<std::uint32_t, bin_count> bin_sizes{};
+			for (std::uint32_t i = begin; i < end; ++i)
+			{
+				std::uint32_t const o = tree.objects[i];
+				std::size_t const b = bin_of(o);
+				bins[b].extend(min[o], max[o]);
+				++bin_sizes[b];
+			}
+
+			// Sweep from the right to get the area of every right-hand side, then from the left
+			std::array<float, bin_count> right_cost;
+			box right_box;
+			std::uint32_t right_size = 0;
+			for (std::size_t b = bin_count - 1; b > 0; --b)
+			{
+				right_box.extend(bins[b].min, bins[b].max);
+				right_size += bin_sizes[b];
+				right_cost[b] = right_box.area() * right_size;
+			}
+
+			float best_cost = inf;
+			std::size_t best_split = 0;
+			box left_box;
+			std::uint32_t left_size = 0;
+			for (std::size_t b = 1; b < bin_count; ++b)
+			{
+				left_box.extend(bins[b - 1].min, bins[b - 1].max);
+				left_size += bin_sizes[b - 1];
+				if (left_size == 0 || left_size == end - begin)
+					continue;
+
+				float const cost = left_box.area() * left_size + right_cost[b];
+				if (cost < best_cost)
+				{
+					best_cost = cost;
+					best_split = b;
+				}
+			}
+
+			float const leaf_cost = bounds.area() * (end - begin);
+			if (best_split == 0 || (traversal_cost * bounds.area() + best_cost >= leaf_cost && end - begin <= max_sah_leaf_size))
+				return index;
+
+			auto const middle = std::partition(tree.objects.begin() + begin, tree.objects.begin() + end,
+				[&](std::uint32_t o){ return bin_of(o) < best_split; });
+			std::uint32_t const split = middle - tree.objects.begin();
+
+			build(begin, split, depth + 1);
+			tree.nodes[index].right = build(split, end, depth + 1);
+			return index;
+		}
+	};
+
+}
+
+void bvh::build(glm::vec3 const * min, glm::vec3 const * max, std::size_t count)
+{
+	nodes.clear();
+	nodes.reserve(2 * count);
+	objects.resize(count);
+	std::iota(objects.begin(), objects.end(), 0);
+
+	if (count == 0)
+	{
+		object_min.clear();
+		object_max.clear();
+		return;
+	}
+
+	builder b{*this, min, max, std::vector<glm::vec3>(count)};
+	for (std::size_t i = 0; i < count; ++i)
+		b.centroids[i] = (min[i] + max[i]) * 0.5f;
+
+	b.build(0, count, 0);
+
+	object_min.resize(count);
+	object_max.resize(count);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		object_min[i] = min[objects[i]];
+		object_max[i] = max[objects[i]];
+	}
+}
+
+void bvh::refit(glm::vec3 const * min, glm::vec3 const * max)
+{
+	for (std::size_t i = 0; i < objects.size(); ++i)
+	{
+		object_min[i] = min[objects[i]];
+		object_max[i] = max[objects[i]];
+	}
+
+	// Children always follow their parent, so a reverse sweep visits them first
+	for (std::size_t i = nodes.size(); i-- > 0;)
+	{
+		auto & n = nodes[i];
+		if (n.right == 0)
+		{
+			n.min = glm::vec3(inf);
+			n.max = glm::vec3(-inf);
+			for (std::uint32_t j = n.begin; j < n.begin + n.count; ++j)
+			{
+				n.min = glm::min(n.min, object_min[j]);
+				n.max = glm::max(n.max, object_max[j]);
+			}
+		}
+		else
+		{
+			auto const & left = nodes[i + 1];
+			auto const & right = nodes[n.right];
+			n.min = glm::min(left.min, right.min);
+			n.max = glm::max(left.max, right.max);
+		}
+	}
+}
+
+std::size_t bvh::cull(frustum const & f, std::vector<std::uint32_t> & visible) const
+{
+	if (nodes.empty())
+		return 0;
+
+	std::size_t tested = 0;
+
+	std::uint32_t stack[max_depth + 2];
+	std::size_t stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0)
+	{
+		auto const & n = nodes[stack[--stack_size]];
+
+		++tested;
+		auto const result = classify(f, n.min, n.max);
+		if (result == cull_result::outside)
+			continue;
+
+		if (result == cull_result::inside)
+		{
+			visible.insert(visible.end(), objects.begin() + n.begin, objects.begin() + n.begin + n.count);
+			continue;
+		}
+
+		if (n.right == 0)
+		{
+			for (std::uint32_t j = n.begin; j < n.begin + n.count; ++j)
+			{
+				++tested;
+				if (classify(f, object_min[j], object_max[j]) != cull_result::outside)
+					visible.push_back(objects[j]);
+			}
+			continue;
+		}
+
+		stack[stack_size++] = n.right;
+		stack[stack_size++] = &n - nodes.data() + 1;
+	}
+
+	return tested;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "culling.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Bounding volume hierarchy over object boxes, built with binned SAH. Nodes are stored
+// depth-first: the left child of an interior node directly follows it, and every node
+// covers a contiguous range of the leaf-ordered object list
+struct bvh
+{
+	struct node
+	{
+		glm::vec3 min;
+		std::uint32_t begin;
+		glm::vec3 max;
+		std::uint32_t count;
+		// Zero for leaves, since the root is never a right child
+		std::uint32_t right;
+	};
+
+	std::vector<node> nodes;
+	// Object indices in leaf order, and their boxes in the same order
+	std::vector<std::uint32_t> objects;
+	std::vector<glm::vec3> object_min;
+	std::vector<glm::vec3> object_max;
+
+	void build(glm::vec3 const * min, glm::vec3 const * max, std::size_t count);
+
+	// Updates boxes of moved objects, indexed as in build(), keeping the topology;
+	// rebuild once the tree quality degrades too much
+	void refit(glm::vec3 const * min, glm::vec3 const * max);
+
+	// Appends indices of objects intersecting the frustum; subtrees fully inside it
+	// are appended without testing. Returns the number of tested boxes
+	std::size_t cull(frustum const & f, std::vector<std::uint32_t> & visible) const;
+};
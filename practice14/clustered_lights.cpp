@@ -0,0 +1,210 @@
+#include "clustered_lights.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+light_clusters::light_clusters(int tiles_x, int tiles_y, int slices)
+	: tiles_x(tiles_x)
+	, tiles_y(tiles_y)
+	, slices(slices)
+	, slice_stride((tiles_x * tiles_y + 7) / 8 * 8)
+	, cluster_lists(cluster_count())
+{
+	assert(tiles_x > 0 && tiles_y > 0 && slices > 0);
+
+	for (auto * v : {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z})
+		v->resize(slices * slice_stride);
+}
+
+void light_clusters::set_projection(float fov_y, float aspect, float z_near, float z_far)
+{
+	assert(0.f < z_near && z_near < z_far);
+
+	this->z_near = z_near;
+	this->z_far = z_far;
+	tan_half_y = std::tan(fov_y / 2.f);
+	tan_half_x = tan_half_y * aspect;
+
+	slice_depths.resize(slices + 1);
+	for (int z = 0; z <= slices; ++z)
+		slice_depths[z] = z_near * std::pow(z_far / z_near, float(z) / slices);
+	slice_depths.back() = z_far;
+
+	for (int z = 0; z < slices; ++z)
+	{
+		float const d0 = slice_depths[z];
+		float const d1 = slice_depths[z + 1];
+		std::size_t const base = z * slice_stride;
+
+		for (int y = 0; y < tiles_y; ++y)
+		{
+			float const y0 = (-1.f + 2.f * y / tiles_y) * tan_half_y;
+			float const y1 = (-1.f + 2.f * (y + 1) / tiles_y) * tan_half_y;
+
+			for (int x = 0; x < tiles_x; ++x)
+			{
+				float const x0 = (-1.f + 2.f * x / tiles_x) * tan_half_x;
+				float const x1 = (-1.f + 2.f * (x + 1) / tiles_x) * tan_half_x;
+
+				// The side planes go through the eye, so the extremes are at either end of the depth range
+				std::size_t const i = base + x + tiles_x * y;
+				min_x[i] = std::min(x0 * d0, x0 * d1);
+				max_x[i] = std::max(x1 * d0, x1 * d1);
+				min_y[i] = std::min(y0 * d0, y0 * d1);
+				max_y[i] = std::max(y1 * d0, y1 * d1);
+				min_z[i] = -d1;
+				max_z[i] = -d0;
+			}
+		}
+
+		// Far enough for the squared distance to overflow to infinity
+		for (std::size_t i = base + tiles_x * tiles_y; i < base + slice_stride; ++i)
+		{
+			min_x[i] = min_y[i] = min_z[i] = 1e30f;
+			max_x[i] = max_y[i] = max_z[i] = 1e30f;
+		}
+	}
+}
+
+float light_clusters::slice_scale() const
+{
+	return slices / std::log(z_far / z_near);
+}
+
+float light_clusters::slice_bias() const
+{
+	return -std::log(z_near) * slice_scale();
+}
+
+int light_clusters::slice(float depth) const
+{
+	int const z = std::floor(std::log(std::max(depth, z_near)) * slice_scale() + slice_bias());
+	return std::clamp(z, 0, slices - 1);
+}
+
+int light_clusters::cluster_of(glm::vec3 const & view_position) const
+{
+	float const depth = -view_position.z;
+	if (!(depth >= z_near && depth <= z_far))
+		return -1;
+
+	float const ndc_x = view_position.x / (depth * tan_half_x);
+	float const ndc_y = view_position.y / (depth * tan_half_y);
+	if (std::abs(ndc_x) > 1.f || std::abs(ndc_y) > 1.f)
+		return -1;
+
+	int const x = std::min<int>((ndc_x + 1.f) * 0.5f * tiles_x, tiles_x - 1);
+	int const y = std::min<int>((ndc_y + 1.f) * 0.5f * tiles_y, tiles_y - 1);
+
+	// The logarithm may land in a neighbouring slice right at a boundary, the bounds decide
+	int z = slice(depth);
+	while (z > 0 && depth < slice_depths[z])
+		--z;
+	while (z + 1 < slices && depth > slice_depths[z + 1])
+		++z;
+
+	return x + tiles_x * (y + tiles_y * z);
+}
+
+void light_clusters::assign(thread_pool & pool, glm::mat4 const & view, point_light const * lights, std::size_t count)
+{
+	assert(!slice_depths.empty());
+
+	view_lights.resize(count);
+	pool.parallel_for(count, 1024, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			glm::vec3 const position(view * glm::vec4(lights[i].position, 1.f));
+			float const radius = lights[i].radius;
+			view_lights[i] = {position, radius * radius, -position.z - radius, -position.z + radius};
+		}
+	});
+
+	std::size_t const slice_size = tiles_x * tiles_y;
+
+	// Each slice fills the lists of its own clusters, visiting lights in order so that the lists are sorted
+	pool.parallel_for(slices, 1, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t z = begin; z < end; ++z)
+		{
+			float const d0 = slice_depths[z];
+			float const d1 = slice_depths[z + 1];
+			std::size_t const base = z * slice_stride;
+			auto * lists = cluster_lists.data() + z * slice_size;
+
+			for (std::size_t i = 0; i < slice_size; ++i)
+				lists[i].clear();
+
+			for (std::size_t l = 0; l < count; ++l)
+			{
+				auto const & light = view_lights[l];
+				if (light.depth_max < d0 || light.depth_min > d1)
+					continue;
+
+#ifdef __AVX__
+				__m256 const px = _mm256_set1_ps(light.position.x);
+				__m256 const py = _mm256_set1_ps(light.position.y);
+				__m256 const pz = _mm256_set1_ps(light.position.z);
+				__m256 const r2 = _mm256_set1_ps(light.radius_squared);
+				__m256 const zero = _mm256_setzero_ps();
+
+				for (std::size_t i = 0; i < slice_size; i += 8)
+				{
+					// Distance from the sphere center to the nearest point of each box
+					__m256 const dx = _mm256_max_ps(_mm256_max_ps(
+						_mm256_sub_ps(_mm256_load_ps(min_x.data() + base + i), px),
+						_mm256_sub_ps(px, _mm256_load_ps(max_x.data() + base + i))), zero);
+					__m256 const dy = _mm256_max_ps(_mm256_max_ps(
+						_mm256_sub_ps(_mm256_load_ps(min_y.data() + base + i), py),
+						_mm256_sub_ps(py, _mm256_load_ps(max_y.data() + base + i))), zero);
+					__m256 const dz = _mm256_max_ps(_mm256_max_ps(
+						_mm256_sub_ps(_mm256_load_ps(min_z.data() + base + i), pz),
+						_mm256_sub_ps(pz, _mm256_load_ps(max_z.data() + base + i))), zero);
+
+					__m256 const d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+					unsigned int mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_LE_OQ));
+
+					for (; mask; mask &= mask - 1)
+						lists[i + std::countr_zero(mask)].push_back(l);
+				}
+#else
+				for (std::size_t i = 0; i < slice_size; ++i)
+				{
+					float const dx = std::max({min_x[base + i] - light.position.x, light.position.x - max_x[base + i], 0.f});
+					float const dy = std::max({min_y[base + i] - light.position.y, light.position.y - max_y[base + i], 0.f});
+					float const dz = std::max({min_z[base + i] - light.position.z, light.position.z - max_z[base + i], 0.f});
+
+					if (dx * dx + dy * dy + dz * dz <= light.radius_squared)
+						lists[i].push_back(l);
+				}
+#endif
+			}
+		}
+	});
+
+	light_offsets.resize(cluster_count());
+	light_counts.resize(cluster_count());
+
+	std::uint32_t total = 0;
+	for (int c = 0; c < cluster_count(); ++c)
+	{
+		light_offsets[c] = total;
+		light_counts[c] = cluster_lists[c].size();
+		total += light_counts[c];
+	}
+
+	// Compaction into one array, again in parallel over slices
+	indices.resize(total);
+	pool.parallel_for(slices, 1, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t c = begin * slice_size; c < end * slice_size; ++c)
+			std::copy(cluster_lists[c].begin(), cluster_lists[c].end(), indices.begin() + light_offsets[c]);
+	});
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "aligned_allocator.hpp"
+#include "thread_pool.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct point_light
+{
+	glm::vec3 position;
+	// Distance at which the light's contribution is cut off
+	float radius;
+	glm::vec3 color;
+};
+
+// Froxel grid over a symmetric perspective frustum: tiles_x by tiles_y screen tiles and slices
+// exponentially spaced depth slices between z_near and z_far. Cluster (x, y, z) has index
+// x + tiles_x * (y + tiles_y * z), with y going up and z = 0 at the near plane
+struct light_clusters
+{
+	light_clusters(int tiles_x, int tiles_y, int slices);
+
+	// Recomputes the froxel bounds, only needed when the projection changes
+	void set_projection(float fov_y, float aspect, float z_near, float z_far);
+
+	// Assigns every light to the clusters its sphere touches, in parallel over slices. Lights are
+	// given in world space and view maps them to the view space of the projection
+	void assign(thread_pool & pool, glm::mat4 const & view, point_light const * lights, std::size_t count);
+
+	int cluster_count() const
+	{
+		return tiles_x * tiles_y * slices;
+	}
+
+	// Slice containing a view-space depth (the distance along -z), clamped to the grid; a shader
+	// computes the same as floor(log(depth) * slice_scale() + slice_bias())
+	int slice(float depth) const;
+
+	float slice_scale() const;
+	float slice_bias() const;
+
+	// Cluster containing a view-space point, or -1 when it is outside the frustum
+	int cluster_of(glm::vec3 const & view_position) const;
+
+	// Lights of cluster c are light_indices[offsets[c], offsets[c] + counts[c]), in increasing order.
+	// The three arrays upload as they are, e.g. to integer buffer textures
+	std::vector<std::uint32_t> const & offsets() const
+	{
+		return light_offsets;
+	}
+
+	std::vector<std::uint32_t> const & counts() const
+	{
+		return light_counts;
+	}
+
+	std::vector<std::uint32_t> const & light_indices() const
+	{
+		return indices;
+	}
+
+private:
+	int tiles_x, tiles_y, slices;
+	float z_near = 0.f, z_far = 0.f;
+	float tan_half_x = 0.f, tan_half_y = 0.f;
+
+	// View-space bounds of the froxels of every slice in structure-of-arrays layout, each slice padded
+	// to a multiple of 8 with boxes that reject every sphere
+	std::size_t slice_stride;
+	std::vector<float> slice_depths;
+	aligned_vector<float> min_x, min_y, min_z;
+	aligned_vector<float> max_x, max_y, max_z;
+
+	struct view_light
+	{
+		glm::vec3 position;
+		float radius_squared;
+		// Depth range covered by the sphere
+		float depth_min, depth_max;
+	};
+
+	std::vector<view_light> view_lights;
+	// Per-cluster lists filled by the slice tasks, kept across calls to avoid reallocating
+	std::vector<std::vector<std::uint32_t>> cluster_lists;
+
+	std::vector<std::uint32_t> light_offsets;
+	std::vector<std::uint32_t> light_counts;
+	std::vector<std::uint32_t> indices;
+};
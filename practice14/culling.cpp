@@ -0,0 +1,258 @@
+#include "culling.hpp"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+void aabb_soa::push_back(glm::vec3 const & min, glm::vec3 const & max)
+{
+	if (count == min_x.size())
+	{
+		for (auto * v : {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z})
+			v->resize(v->size() + 8);
+	}
+
+	set(count++, min, max);
+}
+
+void aabb_soa::set(std::size_t i, glm::vec3 const & min, glm::vec3 const & max)
+{
+	min_x[i] = min.x;
+	min_y[i] = min.y;
+	min_z[i] = min.z;
+	max_x[i] = max.x;
+	max_y[i] = max.y;
+	max_z[i] = max.z;
+}
+
+void aabb_soa::clear()
+{
+	for (auto * v : {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z})
+		v->clear();
+	count = 0;
+}
+
+cull_result classify(frustum const & f, glm::vec3 const & min, glm::vec3 const & max)
+{
+	cull_result result = cull_result::inside;
+
+	for (auto const & plane : f.planes)
+	{
+		// p-vertex is the corner furthest along the plane normal, n-vertex the nearest one
+		glm::vec3 p, n;
+		for (int i = 0; i < 3; ++i)
+		{
+			p[i] = (plane[i] >= 0.f) ? max[i] : min[i];
+			n[i] = (plane[i] >= 0.f) ? min[i] : max[i];
+		}
+
+		if (glm::dot(glm::vec3(plane), p) + plane.w < 0.f)
+			return cull_result::outside;
+		if (glm::dot(glm::vec3(plane), n) + plane.w < 0.f)
+			result = cull_result::intersect;
+	}
+
+	return result;
+}
+
+#ifdef __AVX__
+
+namespace
+{
+
+	// Planes broadcast for testing eight boxes at once. The plane is the same for the whole batch,
+	// so p/n-vertex selection picks the min or the max array once per plane instead of blending
+	struct batch_frustum
+	{
+		struct plane
+		{
+			__m256 a, b, c, d;
+			int p[3], n[3];
+		};
+
+		plane planes[6];
+
+		explicit batch_frustum(frustum const & f)
+		{
+			for (int i = 0; i < 6; ++i)
+			{
+				auto const & plane = f.planes[i];
+				planes[i].a = _mm256_set1_ps(plane.x);
+				planes[i].b = _mm256_set1_ps(plane.y);
+				planes[i].c = _mm256_set1_ps(plane.z);
+				planes[i].d = _mm256_set1_ps(plane.w);
+				for (int j = 0; j < 3; ++j)
+				{
+					planes[i].p[j] = (plane[j] >= 0.f) ? j + 3 : j;
+					planes[i].n[j] = (plane[j] >= 0.f) ? j : j + 3;
+				}
+			}
+		}
+
+		// Returns the outside and intersect bit masks of boxes [i, i + 8)
+		std::pair<int, int> classify(float const * const * bounds, std::size_t i) const
+		{
+			__m256 const zero = _mm256_setzero_ps();
+			__m256 outside = zero;
+			__m256 intersect = zero;
+
+			for (auto const & plane : planes)
+			{
+				__m256 p = _mm256_add_ps(plane.d, _mm256_mul_ps(plane.a, _mm256_load_ps(bounds[plane.p[0]] + i)));
+				p = _mm256_add_ps(p, _mm256_mul_ps(plane.b, _mm256_load_ps(bounds[plane.p[1]] + i)));
+				p = _mm256_add_ps(p, _mm256_mul_ps(plane.c, _mm256_load_ps(bounds[plane.p[2]] + i)));
+
+				__m256 n = _mm256_add_ps(plane.d, _mm256_mul_ps(plane.a, _mm256_load_ps(bounds[plane.n[0]] + i)));
+				n = _mm256_add_ps(n, _mm256_mul_ps(plane.b, _mm256_load_ps(bounds[plane.n[1]] + i)));
+				n = _mm256_add_ps(n, _mm256_mul_ps(plane.c, _mm256_load_ps(bounds[plane.n[2]] + i)));
+
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(p, zero, _CMP_LT_OQ));
+				intersect = _mm256_or_ps(intersect, _mm256_cmp_ps(n, zero, _CMP_LT_OQ));
+			}
+
+			return {_mm256_movemask_ps(outside), _mm256_movemask_ps(intersect)};
+		}
+	};
+
+	std::array<float const *, 6> bounds_of(aabb_soa const & boxes)
+	{
+		return {
+			boxes.min_x.data(), boxes.min_y.data(), boxes.min_z.data(),
+			boxes.max_x.data(), boxes.max_y.data(), boxes.max_z.data(),
+		};
+	}
+
+}
+
+void classify(frustum const & f, aabb_soa const & boxes, cull_result * results)
+{
+	batch_frustum const batch(f);
+	auto const bounds = bounds_of(boxes);
+
+	for (std::size_t i = 0; i < boxes.size(); i += 8)
+	{
+		auto const [outside_mask, intersect_mask] = batch.classify(bounds.data(), i);
+
+		std::size_t const end = std::min<std::size_t>(8, boxes.size() - i);
+		for (std::size_t j = 0; j < end; ++j)
+		{
+			if (outside_mask & (1 << j))
+				results[i + j] = cull_result::outside;
+			else if (intersect_mask & (1 << j))
+				results[i + j] = cull_result::intersect;
+			else
+				results[i + j] = cull_result::inside;
+		}
+	}
+}
+
+#else
+
+void classify(frustum const & f, aabb_soa const & boxes, cull_result * results)
+{
+	for (std::size_t i = 0; i < boxes.size(); ++i)
+	{
+		results[i] = classify(f,
+			{boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]},
+			{boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]});
+	}
+}
+
+#endif
+
+void cull_views(thread_pool & pool, frustum const * views, std::size_t view_count, aabb_soa const & boxes, multi_view_culling & result)
+{
+	assert(view_count <= 32);
+
+	std::size_t const count = boxes.size();
+	std::size_t const block_count = (count + multi_view_culling::block_size - 1) / multi_view_culling::block_size;
+
+	result.masks.resize(count);
+	result.visible.resize(view_count);
+	result.block_offsets.assign(block_count * view_count, 0);
+
+#ifdef __AVX__
+	// Built in place in the reused storage, so that culling every frame allocates nothing once the lists have grown
+	static_assert(std::is_trivially_destructible_v<batch_frustum> && alignof(batch_frustum) <= 32 && sizeof(batch_frustum) % sizeof(float) == 0);
+	result.batch_views.resize(view_count * sizeof(batch_frustum) / sizeof(float));
+	for (std::size_t v = 0; v < view_count; ++v)
+		new (result.batch_views.data() + v * sizeof(batch_frustum) / sizeof(float)) batch_frustum(views[v]);
+	auto const * batches = std::launder(reinterpret_cast<batch_frustum const *>(result.batch_views.data()));
+	auto const bounds = bounds_of(boxes);
+#endif
+
+	// First pass: visibility masks of every object and per-block visible counts of every view
+	pool.parallel_for(count, multi_view_culling::block_size, [&](std::size_t begin, std::size_t end)
+	{
+		std::uint32_t * counts = result.block_offsets.data() + (begin / multi_view_culling::block_size) * view_count;
+
+#ifdef __AVX__
+		for (std::size_t i = begin; i < end; i += 8)
+		{
+			// Padding past the last box is not classified meaningfully
+			unsigned int const tail_mask = (1u << std::min<std::size_t>(8, end - i)) - 1;
+
+			std::uint32_t masks[8] = {};
+			for (std::size_t v = 0; v < view_count; ++v)
+			{
+				unsigned int visible = ~batches[v].classify(bounds.data(), i).first & tail_mask;
+				counts[v] += std::popcount(visible);
+				for (; visible; visible &= visible - 1)
+					masks[std::countr_zero(visible)] |= 1u << v;
+			}
+			std::copy(masks, masks + std::min<std::size_t>(8, end - i), result.masks.begin() + i);
+		}
+#else
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			glm::vec3 const min(boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]);
+			glm::vec3 const max(boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]);
+
+			std::uint32_t mask = 0;
+			for (std::size_t v = 0; v < view_count; ++v)
+			{
+				if (classify(views[v], min, max) != cull_result::outside)
+				{
+					mask |= 1u << v;
+					++counts[v];
+				}
+			}
+			result.masks[i] = mask;
+		}
+#endif
+	});
+
+	// Exclusive prefix sums turn the counts into write offsets into each view's list
+	for (std::size_t v = 0; v < view_count; ++v)
+	{
+		std::uint32_t total = 0;
+		for (std::size_t b = 0; b < block_count; ++b)
+			total += std::exchange(result.block_offsets[b * view_count + v], total);
+		result.visible[v].resize(total);
+	}
+
+	// Second pass: scatter object indices into the per-view lists, keeping them sorted
+	pool.parallel_for(count, multi_view_culling::block_size, [&](std::size_t begin, std::size_t end)
+	{
+		std::uint32_t * offsets = result.block_offsets.data() + (begin / multi_view_culling::block_size) * view_count;
+
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			for (std::uint32_t mask = result.masks[i]; mask; mask &= mask - 1)
+			{
+				int const v = std::countr_zero(mask);
+				result.visible[v][offsets[v]++] = i;
+			}
+		}
+	});
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "aligned_allocator.hpp"
+#include "frustum.hpp"
+#include "thread_pool.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
+
+enum class cull_result : std::uint8_t
+{
+	outside,
+	intersect,
+	inside,
+};
+
+// Boxes in structure-of-arrays layout, padded to a multiple of 8 so that batches never read past the end
+struct aabb_soa
+{
+	aligned_vector<float> min_x, min_y, min_z;
+	aligned_vector<float> max_x, max_y, max_z;
+
+	std::size_t size() const
+	{
+		return count;
+	}
+
+	void push_back(glm::vec3 const & min, glm::vec3 const & max);
+	void set(std::size_t i, glm::vec3 const & min, glm::vec3 const & max);
+	void clear();
+
+private:
+	std::size_t count = 0;
+};
+
+// Conservative: a box near a frustum corner may be classified as intersect while being outside
+cull_result classify(frustum const & f, glm::vec3 const & min, glm::vec3 const & max);
+
+// Classifies boxes [0, boxes.size()) eight at a time, results must hold boxes.size() entries
+void classify(frustum const & f, aabb_soa const & boxes, cull_result * results);
+
+struct multi_view_culling
+{
+	// Objects handled by one task, a multiple of the SIMD batch size
+	static constexpr std::size_t block_size = 1024;
+
+	// Bit v of masks[i] is set when object i is visible in view v
+	std::vector<std::uint32_t> masks;
+	// Indices of the objects visible in each view, in increasing order
+	std::vector<std::vector<std::uint32_t>> visible;
+	// Per block and per view visible counts, then write offsets
+	std::vector<std::uint32_t> block_offsets;
+	// Storage for the views prepared for the batched test
+	aligned_vector<float> batch_views;
+};
+
+// Tests every box against up to 32 views in a single pass over the boxes, in parallel over blocks
+// of objects. Reusing result across frames avoids reallocating the lists
+void cull_views(thread_pool & pool, frustum const * views, std::size_t view_count, aabb_soa const & boxes, multi_view_culling & result);
@@ -4,33 +4,38 @@
 
 frustum::frustum(glm::mat4 const & view_projection)
 {
-	glm::mat4 m = glm::inverse(view_projection);
-	for (std::size_t i = 0; i < 8; ++i)
-	{
-		glm::vec4 v;
-		v.x = (i & 1) ? 1.f : -1.f;
-		v.y = (i & 2) ? 1.f : -1.f;
-		v.z = (i & 4) ? 1.f : -1.f;
-		v.w = 1.f;
-
-		v = m * v;
-		v = v / v.w;
-		vertices[i] = v.xyz();
-	}
-
-	auto n = [&](std::size_t i0, std::size_t i1, std::size_t i2) -> glm::vec3
+	auto row = [&](int i)
 	{
-		return glm::cross(vertices[i1] - vertices[i0], vertices[i2] - vertices[i0]);
+		return glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
 	};
 
-	face_normals = {
-		n(0, 1, 2),
-		n(4, 0, 2),
-		n(1, 5, 3),
-		n(0, 4, 1),
-		n(2, 3, 6),
+	// Gribb & Hartmann: -w <= x, y, z <= w in clip space
+	planes = {
+		row(3) + row(0),
+		row(3) - row(0),
+		row(3) + row(1),
+		row(3) - row(1),
+		row(3) + row(2),
+		row(3) - row(2),
 	};
 
+	for (auto & p : planes)
+		p /= glm::length(glm::vec3(p));
+
+	// Corners are intersections of one plane from each of the x, y and z pairs
+	auto corner = [&](glm::vec4 const & p0, glm::vec4 const & p1, glm::vec4 const & p2) -> glm::vec3
+	{
+		glm::vec3 const n0(p0), n1(p1), n2(p2);
+		glm::vec3 const c12 = glm::cross(n1, n2);
+		return -(p0.w * c12 + p1.w * glm::cross(n2, n0) + p2.w * glm::cross(n0, n1)) / glm::dot(n0, c12);
+	};
+
+	for (std::size_t i = 0; i < 8; ++i)
+		vertices[i] = corner(planes[(i & 1) ? 1 : 0], planes[(i & 2) ? 3 : 2], planes[(i & 4) ? 5 : 4]);
+
+	for (std::size_t i = 0; i < 5; ++i)
+		face_normals[i] = glm::vec3(planes[i]);
+
 	auto e = [&](std::size_t i0, std::size_t i1) -> glm::vec3
 	{
 		return vertices[i1] - vertices[i0];
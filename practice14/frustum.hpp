@@ -1,13 +1,19 @@
 #pragma once
 
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
 
 #include <array>
 
 struct frustum
 {
+	// Normalized planes (n, d) with dot(n, p) + d >= 0 inside,
+	// in the order left, right, bottom, top, near, far
+	std::array<glm::vec4, 6> planes;
+
 	std::array<glm::vec3, 8> vertices;
+	// The far plane is parallel to the near one, so SAT only needs five distinct normals
 	std::array<glm::vec3, 5> face_normals;
 	std::array<glm::vec3, 6> edge_directions;
 
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "body_traits.hpp"
+
 #include <glm/vec3.hpp>
 #include <glm/geometric.hpp>
 
+#include <cstdint>
 #include <limits>
 #include <utility>
 #include <cmath>
@@ -10,19 +13,7 @@
 template <typename Body>
 std::pair<float, float> project(Body const & b, glm::vec3 const & n)
 {
-	static constexpr float inf = std::numeric_limits<float>::infinity();
-
-	float min = inf;
-	float max = -inf;
-
-	for (auto const & p : b.vertices)
-	{
-		float v = glm::dot(p, n);
-		min = std::min(min, v);
-		max = std::max(max, v);
-	}
-
-	return {min, max};
+	return body_traits<Body>::project(b, n);
 }
 
 template <typename Body1, typename Body2>
@@ -34,18 +25,93 @@ bool intersect_along(Body1 const & b1, Body2 const & b2, glm::vec3 const & n)
 	return (min1 <= max2) && (min2 <= max1);
 }
 
+template <typename Body1, typename Body2>
+bool intersect_along_cardinal(Body1 const & b1, Body2 const & b2, int axis)
+{
+	auto [min1, max1] = body_traits<Body1>::project_cardinal(b1, axis);
+	auto [min2, max2] = body_traits<Body2>::project_cardinal(b2, axis);
+
+	return (min1 <= max2) && (min2 <= max1);
+}
+
+// Axes numbered in the order intersect() tries them: face normals of b1, of b2, edge cross products,
+// then the point axes of curved bodies
+template <typename Body1, typename Body2>
+std::size_t separating_axis_count(Body1 const & b1, Body2 const & b2)
+{
+	std::size_t result = b1.face_normals.size() + b2.face_normals.size() + b1.edge_directions.size() * b2.edge_directions.size();
+	if constexpr (body_traits<Body1>::point_axes)
+		result += b2.vertices.size();
+	if constexpr (body_traits<Body2>::point_axes)
+		result += b1.vertices.size();
+	return result;
+}
+
+// Tests the axis with the given number
+template <typename Body1, typename Body2>
+bool intersect_along_axis(Body1 const & b1, Body2 const & b2, std::size_t index)
+{
+	if (index < b1.face_normals.size())
+	{
+		if constexpr (body_traits<Body1>::axis_aligned)
+			return intersect_along_cardinal(b1, b2, index);
+		else
+			return intersect_along(b1, b2, b1.face_normals[index]);
+	}
+	index -= b1.face_normals.size();
+
+	if (index < b2.face_normals.size())
+	{
+		if constexpr (body_traits<Body2>::axis_aligned)
+			return intersect_along_cardinal(b1, b2, index);
+		else
+			return intersect_along(b1, b2, b2.face_normals[index]);
+	}
+	index -= b2.face_normals.size();
+
+	if (index < b1.edge_directions.size() * b2.edge_directions.size())
+	{
+		auto const & e1 = b1.edge_directions[index / b2.edge_directions.size()];
+		auto const & e2 = b2.edge_directions[index % b2.edge_directions.size()];
+		return intersect_along(b1, b2, glm::cross(e1, e2));
+	}
+	index -= b1.edge_directions.size() * b2.edge_directions.size();
+
+	if constexpr (body_traits<Body1>::point_axes)
+	{
+		if (index < b2.vertices.size())
+			return intersect_along(b1, b2, b2.vertices[index] - body_traits<Body1>::center(b1));
+		index -= b2.vertices.size();
+	}
+
+	if constexpr (body_traits<Body2>::point_axes)
+		return intersect_along(b1, b2, b1.vertices[index] - body_traits<Body2>::center(b2));
+
+	return true;
+}
+
 template <typename Body1, typename Body2>
 bool intersect(Body1 const & b1, Body2 const & b2)
 {
-	for (auto const & n : b1.face_normals)
+	for (std::size_t i = 0; i < b1.face_normals.size(); ++i)
 	{
-		if (!intersect_along(b1, b2, n))
+		if constexpr (body_traits<Body1>::axis_aligned)
+		{
+			if (!intersect_along_cardinal(b1, b2, i))
+				return false;
+		}
+		else if (!intersect_along(b1, b2, b1.face_normals[i]))
 			return false;
 	}
 
-	for (auto const & n : b2.face_normals)
+	for (std::size_t i = 0; i < b2.face_normals.size(); ++i)
 	{
-		if (!intersect_along(b1, b2, n))
+		if constexpr (body_traits<Body2>::axis_aligned)
+		{
+			if (!intersect_along_cardinal(b1, b2, i))
+				return false;
+		}
+		else if (!intersect_along(b1, b2, b2.face_normals[i]))
 			return false;
 	}
 
@@ -59,5 +125,95 @@ bool intersect(Body1 const & b1, Body2 const & b2)
 		}
 	}
 
+	if constexpr (body_traits<Body1>::point_axes)
+	{
+		for (auto const & p : b2.vertices)
+		{
+			if (!intersect_along(b1, b2, p - body_traits<Body1>::center(b1)))
+				return false;
+		}
+	}
+
+	if constexpr (body_traits<Body2>::point_axes)
+	{
+		for (auto const & p : b1.vertices)
+		{
+			if (!intersect_along(b1, b2, p - body_traits<Body2>::center(b2)))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+// Per pair of bodies: the axis that separated them last time, which is most likely to separate them again
+struct separating_axis_cache
+{
+	static constexpr std::uint32_t no_axis = -1;
+
+	std::uint32_t axis = no_axis;
+};
+
+struct separating_axis_stats
+{
+	std::size_t tests = 0;
+	std::size_t axes = 0;
+	std::size_t cache_hits = 0;
+	std::size_t separated = 0;
+
+	// Fraction of separated pairs rejected by their cached axis alone
+	float early_out_rate() const
+	{
+		return separated ? float(cache_hits) / separated : 0.f;
+	}
+
+	float axes_per_test() const
+	{
+		return tests ? float(axes) / tests : 0.f;
+	}
+};
+
+// Same result as intersect(b1, b2), trying the cached axis first and remembering the separating one
+template <typename Body1, typename Body2>
+bool intersect(Body1 const & b1, Body2 const & b2, separating_axis_cache & cache, separating_axis_stats * stats = nullptr)
+{
+	if (stats)
+		++stats->tests;
+
+	if (cache.axis != separating_axis_cache::no_axis)
+	{
+		if (stats)
+			++stats->axes;
+
+		if (!intersect_along_axis(b1, b2, cache.axis))
+		{
+			if (stats)
+			{
+				++stats->cache_hits;
+				++stats->separated;
+			}
+			return false;
+		}
+	}
+
+	std::size_t const count = separating_axis_count(b1, b2);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		if (i == cache.axis)
+			continue;
+
+		if (stats)
+			++stats->axes;
+
+		if (!intersect_along_axis(b1, b2, i))
+		{
+			cache.axis = i;
+			if (stats)
+				++stats->separated;
+			return false;
+		}
+	}
+
+	cache.axis = separating_axis_cache::no_axis;
 	return true;
 }
@@ -0,0 +1,21 @@
+#include "obb.hpp"
+
+obb::obb(glm::vec3 const & center, glm::mat3 const & axes, glm::vec3 const & extents)
+	: center(center)
+	, axes(axes)
+	, extents(extents)
+{
+	for (std::size_t i = 0; i < 8; ++i)
+	{
+		vertices[i] = center;
+		vertices[i] += axes[0] * ((i & 1) ? extents.x : -extents.x);
+		vertices[i] += axes[1] * ((i & 2) ? extents.y : -extents.y);
+		vertices[i] += axes[2] * ((i & 4) ? extents.z : -extents.z);
+	}
+
+	for (int i = 0; i < 3; ++i)
+	{
+		face_normals[i] = axes[i];
+		edge_directions[i] = axes[i];
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "body_traits.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/gtc/matrix_access.hpp>
+
+#include <array>
+
+// Oriented box: axes are the orthonormal columns of the rotation, extents are half sizes along them
+struct obb
+{
+	obb(glm::vec3 const & center, glm::mat3 const & axes, glm::vec3 const & extents);
+
+	glm::vec3 center;
+	glm::mat3 axes;
+	glm::vec3 extents;
+
+	std::array<glm::vec3, 8> vertices;
+	std::array<glm::vec3, 3> face_normals;
+	std::array<glm::vec3, 3> edge_directions;
+};
+
+template <>
+struct body_traits<obb>
+{
+	static constexpr bool axis_aligned = false;
+	static constexpr bool point_axes = false;
+
+	static std::pair<float, float> project(obb const & b, glm::vec3 const & n)
+	{
+		float const center = glm::dot(b.center, n);
+		float const radius = glm::dot(b.extents, glm::abs(glm::transpose(b.axes) * n));
+		return {center - radius, center + radius};
+	}
+
+	static std::pair<float, float> project_cardinal(obb const & b, int axis)
+	{
+		float const radius = glm::dot(b.extents, glm::abs(glm::row(b.axes, axis)));
+		return {b.center[axis] - radius, b.center[axis] + radius};
+	}
+};
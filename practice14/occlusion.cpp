@@ -0,0 +1,532 @@
+#include "occlusion.hpp"
+
+#include <glm/common.hpp>
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <tuple>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+	// Rows merged by one task
+	constexpr int band_height = 8;
+
+	// Keeps the nearer of two rows of depths, aligned and a multiple of 8 long
+	void merge_row(float * target, float const * source, int count)
+	{
+#ifdef __AVX__
+		for (int x = 0; x < count; x += 8)
+			_mm256_store_ps(target + x, _mm256_min_ps(_mm256_load_ps(target + x), _mm256_load_ps(source + x)));
+#else
+		for (int x = 0; x < count; ++x)
+			target[x] = std::min(target[x], source[x]);
+#endif
+	}
+
+	template <typename Index>
+	void build_occluder_mesh(glm::vec3 const * positions, Index const * indices, std::size_t index_count, occluder_mesh & result)
+	{
+		// Weld vertices split by other attributes, otherwise every seam would look like an open edge
+		std::map<std::tuple<float, float, float>, std::uint32_t> welded;
+		result.indices.resize(index_count - index_count % 3);
+		for (std::size_t i = 0; i < result.indices.size(); ++i)
+		{
+			glm::vec3 const & p = positions[indices[i]];
+			auto [it, inserted] = welded.emplace(std::make_tuple(p.x, p.y, p.z), result.positions.size());
+			if (inserted)
+				result.positions.push_back(p);
+			result.indices[i] = it->second;
+		}
+
+		// Pair every directed edge with its reverse; edges used more than twice are left unpaired
+		std::map<std::pair<std::uint32_t, std::uint32_t>, std::uint32_t> edges;
+		std::map<std::pair<std::uint32_t, std::uint32_t>, int> uses;
+		for (std::size_t i = 0; i < result.indices.size(); ++i)
+		{
+			std::uint32_t const a = result.indices[i];
+			std::uint32_t const b = result.indices[i - i % 3 + (i + 1) % 3];
+			edges[{a, b}] = i / 3;
+			++uses[{std::min(a, b), std::max(a, b)}];
+		}
+
+		result.neighbours.assign(result.indices.size(), occluder_mesh::no_neighbour);
+		for (std::size_t i = 0; i < result.indices.size(); ++i)
+		{
+			std::uint32_t const a = result.indices[i];
+			std::uint32_t const b = result.indices[i - i % 3 + (i + 1) % 3];
+			if (uses[{std::min(a, b), std::max(a, b)}] != 2)
+				continue;
+			if (auto it = edges.find({b, a}); it != edges.end())
+				result.neighbours[i] = it->second;
+		}
+	}
+
+}
+
+occluder_mesh::occluder_mesh(glm::vec3 const * positions, std::uint16_t const * indices, std::size_t index_count)
+{
+	build_occluder_mesh(positions, indices, index_count, *this);
+}
+
+occluder_mesh::occluder_mesh(glm::vec3 const * positions, std::uint32_t const * indices, std::size_t index_count)
+{
+	build_occluder_mesh(positions, indices, index_count, *this);
+}
+
+occlusion_culler::occlusion_culler(int width, int height)
+	: width_((std::max(width, 1) + 7) & ~7)
+	, height_(std::max(height, 1))
+{
+	for (int w = width_, h = height_;; w = (w + 1) / 2, h = (h + 1) / 2)
+	{
+		level_width.push_back(w);
+		level_height.push_back(h);
+		pyramid.emplace_back(std::size_t(w) * h, 1.f);
+		if (w == 1 && h == 1)
+			break;
+	}
+}
+
+void occlusion_culler::begin(glm::mat4 const & view_projection)
+{
+	this->view_projection = view_projection;
+	occluders.clear();
+	std::fill(pyramid[0].begin(), pyramid[0].end(), 1.f);
+}
+
+void occlusion_culler::add_occluder(glm::mat4 const & model, occluder_mesh const & mesh)
+{
+	occluders.push_back({view_projection * model, &mesh});
+}
+
+std::size_t occlusion_culler::triangle_count() const
+{
+	std::size_t result = 0;
+	for (auto const & w : workers)
+		result += w.triangle_count;
+	return result;
+}
+
+void occlusion_culler::setup(occluder const & o, setup_scratch & scratch) const
+{
+	auto const & mesh = *o.mesh;
+
+	scratch.clip.resize(mesh.positions.size());
+	scratch.window.resize(mesh.positions.size());
+	for (std::size_t i = 0; i < mesh.positions.size(); ++i)
+	{
+		scratch.clip[i] = o.transform * glm::vec4(mesh.positions[i], 1.f);
+		scratch.window[i] = window(scratch.clip[i]);
+	}
+
+	auto in_front = [](glm::vec4 const & v){ return v.z >= -v.w; };
+
+	// Triangles crossing the near plane count as not front-facing, so their neighbours get silhouette edges
+	scratch.front.resize(mesh.triangle_count());
+	for (std::size_t t = 0; t < mesh.triangle_count(); ++t)
+	{
+		std::uint32_t const * i = mesh.indices.data() + 3 * t;
+
+		bool front = in_front(scratch.clip[i[0]]) && in_front(scratch.clip[i[1]]) && in_front(scratch.clip[i[2]]);
+		if (front)
+		{
+			glm::vec3 const & a = scratch.window[i[0]], & b = scratch.window[i[1]], & c = scratch.window[i[2]];
+			front = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y) > 0.f;
+		}
+		scratch.front[t] = front;
+	}
+
+	scratch.triangles.clear();
+	scratch.clipped.clear();
+	scratch.silhouette.clear();
+	for (std::size_t t = 0; t < mesh.triangle_count(); ++t)
+	{
+		std::uint32_t const * i = mesh.indices.data() + 3 * t;
+
+		if (scratch.front[t])
+		{
+			glm::vec3 const v[3] = {scratch.window[i[0]], scratch.window[i[1]], scratch.window[i[2]]};
+			setup_triangle(v, scratch.triangles);
+
+			// Edges shared with another front face are interior to the projected occluder
+			for (int k = 0; k < 3; ++k)
+			{
+				std::uint32_t const n = mesh.neighbours[3 * t + k];
+				if (n == occluder_mesh::no_neighbour || !scratch.front[n])
+				{
+					scratch.silhouette.push_back(v[k]);
+					scratch.silhouette.push_back(v[(k + 1) % 3]);
+				}
+			}
+			continue;
+		}
+
+		glm::vec4 const clip[3] = {scratch.clip[i[0]], scratch.clip[i[1]], scratch.clip[i[2]]};
+
+		int inside = 0;
+		for (int k = 0; k < 3; ++k)
+			inside += in_front(clip[k]);
+
+		if (inside == 0 || inside == 3)
+			continue;
+
+		// Clip against the near plane, which yields a triangle or a quad
+		glm::vec3 polygon[4];
+		int size = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			auto const & a = clip[k];
+			auto const & b = clip[(k + 1) % 3];
+			float const da = a.z + a.w;
+			float const db = b.z + b.w;
+
+			if (da >= 0.f)
+				polygon[size++] = window(a);
+			if ((da >= 0.f) != (db >= 0.f))
+				polygon[size++] = window(a + (b - a) * (da / (da - db)));
+		}
+
+		setup_triangle(polygon, scratch.clipped);
+		if (size == 4)
+		{
+			glm::vec3 const second[3] = {polygon[0], polygon[2], polygon[3]};
+			setup_triangle(second, scratch.clipped);
+		}
+	}
+
+	if (scratch.triangles.empty() && scratch.clipped.empty())
+		return;
+
+	scratch.triangle_count += scratch.triangles.size() + scratch.clipped.size();
+
+	int min_x = width_, max_x = 0, min_y = height_, max_y = 0;
+	for (auto const * triangles : {&scratch.triangles, &scratch.clipped})
+		for (auto const & t : *triangles)
+		{
+			min_x = std::min(min_x, t.min_x);
+			max_x = std::max(max_x, t.max_x);
+			min_y = std::min(min_y, t.min_y);
+			max_y = std::max(max_y, t.max_y);
+		}
+
+	occluder_tile tile;
+	tile.min_x = min_x & ~7;
+	tile.width = (max_x | 7) + 1 - tile.min_x;
+	tile.min_y = min_y;
+	tile.max_y = max_y;
+	tile.offset = scratch.depths.size();
+
+	std::size_t const size = std::size_t(tile.width) * (max_y - min_y + 1);
+	scratch.depths.resize(tile.offset + size, 0.f);
+	scratch.coverage.assign(size, 0u);
+	float * depth = scratch.depths.data() + tile.offset;
+
+	// A pixel is entirely covered if its centre is, and no silhouette edge crosses it. Its depth is then
+	// the farthest depth of every front face touching it, which bounds the nearest one at every point
+	for (auto const & t : scratch.triangles)
+		rasterize(t, tile, depth, scratch.coverage.data());
+	for (std::size_t i = 0; i < scratch.silhouette.size(); i += 2)
+		rasterize_edge(scratch.silhouette[i], scratch.silhouette[i + 1], tile, scratch.coverage.data());
+	for (std::size_t i = 0; i < size; ++i)
+		if (!scratch.coverage[i])
+			depth[i] = 1.f;
+
+	// Pieces of faces crossing the near plane are only kept where they cover whole pixels on their own
+	for (auto const & t : scratch.clipped)
+		rasterize_inner(t, tile, depth);
+
+	scratch.tiles.push_back(tile);
+}
+
+glm::vec3 occlusion_culler::window(glm::vec4 const & clip) const
+{
+	glm::vec3 const ndc = glm::vec3(clip) / clip.w;
+	return {(ndc.x * 0.5f + 0.5f) * width_, (ndc.y * 0.5f + 0.5f) * height_, ndc.z * 0.5f + 0.5f};
+}
+
+void occlusion_culler::setup_triangle(glm::vec3 const * v, std::vector<screen_triangle> & output) const
+{
+	// Back faces and degenerate triangles are skipped
+	float const area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+	if (area < 1e-8f)
+		return;
+
+	screen_triangle t;
+	t.min_x = std::max(0, int(std::floor(std::min({v[0].x, v[1].x, v[2].x}))));
+	t.max_x = std::min(width_ - 1, int(std::floor(std::max({v[0].x, v[1].x, v[2].x}))));
+	t.min_y = std::max(0, int(std::floor(std::min({v[0].y, v[1].y, v[2].y}))));
+	t.max_y = std::min(height_ - 1, int(std::floor(std::max({v[0].y, v[1].y, v[2].y}))));
+	if (t.min_x > t.max_x || t.min_y > t.max_y)
+		return;
+
+	for (int k = 0; k < 3; ++k)
+	{
+		auto const & a = v[k];
+		auto const & b = v[(k + 1) % 3];
+		t.edge_a[k] = a.y - b.y;
+		t.edge_b[k] = b.x - a.x;
+		t.edge_c[k] = a.x * b.y - a.y * b.x;
+	}
+
+	// Depth is affine in window space: solve for the plane through the three vertices,
+	// then offset it to the farthest depth the plane reaches over a pixel
+	float const dx1 = v[1].x - v[0].x, dy1 = v[1].y - v[0].y, dz1 = v[1].z - v[0].z;
+	float const dx2 = v[2].x - v[0].x, dy2 = v[2].y - v[0].y, dz2 = v[2].z - v[0].z;
+	t.depth_a = (dz1 * dy2 - dz2 * dy1) / area;
+	t.depth_b = (dz2 * dx1 - dz1 * dx2) / area;
+	t.depth_c = v[0].z - t.depth_a * v[0].x - t.depth_b * v[0].y;
+	t.depth_c += 0.5f * (std::abs(t.depth_a) + std::abs(t.depth_b));
+
+	output.push_back(t);
+}
+
+#ifdef __AVX__
+
+void occlusion_culler::rasterize(screen_triangle const & t, occluder_tile const & tile, float * depth, std::uint32_t * coverage)
+{
+	// Pixels touching the triangle are inside every edge moved out by its extent over half a pixel
+	__m256 a[3], b[3], c[3], touch[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		a[k] = _mm256_set1_ps(t.edge_a[k]);
+		b[k] = _mm256_set1_ps(t.edge_b[k]);
+		c[k] = _mm256_set1_ps(t.edge_c[k]);
+		touch[k] = _mm256_set1_ps(-0.5f * (std::abs(t.edge_a[k]) + std::abs(t.edge_b[k])));
+	}
+
+	__m256 const depth_a = _mm256_set1_ps(t.depth_a);
+	__m256 const depth_b = _mm256_set1_ps(t.depth_b);
+	__m256 const depth_c = _mm256_set1_ps(t.depth_c);
+	__m256 const offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	__m256 const zero = _mm256_setzero_ps();
+
+	for (int y = t.min_y; y <= t.max_y; ++y)
+	{
+		__m256 const py = _mm256_set1_ps(y + 0.5f);
+		std::size_t const row = std::size_t(y - tile.min_y) * tile.width - tile.min_x;
+
+		for (int x = t.min_x & ~7; x <= t.max_x; x += 8)
+		{
+			__m256 const px = _mm256_add_ps(_mm256_set1_ps(float(x)), offsets);
+
+			__m256 touched = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			__m256 inside = touched;
+			for (int k = 0; k < 3; ++k)
+			{
+				__m256 const e = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[k], px), _mm256_mul_ps(b[k], py)), c[k]);
+				touched = _mm256_and_ps(touched, _mm256_cmp_ps(e, touch[k], _CMP_GE_OQ));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(e, zero, _CMP_GE_OQ));
+			}
+
+			if (_mm256_movemask_ps(touched) == 0)
+				continue;
+
+			__m256 const d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(depth_a, px), _mm256_mul_ps(depth_b, py)), depth_c);
+			__m256 const current = _mm256_load_ps(depth + row + x);
+			_mm256_store_ps(depth + row + x, _mm256_blendv_ps(current, _mm256_max_ps(current, d), touched));
+
+			float * covered = reinterpret_cast<float *>(coverage + row + x);
+			_mm256_store_ps(covered, _mm256_or_ps(_mm256_load_ps(covered), inside));
+		}
+	}
+}
+
+#else
+
+void occlusion_culler::rasterize(screen_triangle const & t, occluder_tile const & tile, float * depth, std::uint32_t * coverage)
+{
+	// Pixels touching the triangle are inside every edge moved out by its extent over half a pixel
+	float touch[3];
+	for (int k = 0; k < 3; ++k)
+		touch[k] = -0.5f * (std::abs(t.edge_a[k]) + std::abs(t.edge_b[k]));
+
+	for (int y = t.min_y; y <= t.max_y; ++y)
+	{
+		float const py = y + 0.5f;
+		std::size_t const row = std::size_t(y - tile.min_y) * tile.width - tile.min_x;
+
+		for (int x = t.min_x; x <= t.max_x; ++x)
+		{
+			float const px = x + 0.5f;
+
+			bool touched = true, inside = true;
+			for (int k = 0; k < 3; ++k)
+			{
+				float const e = t.edge_a[k] * px + t.edge_b[k] * py + t.edge_c[k];
+				touched = touched && e >= touch[k];
+				inside = inside && e >= 0.f;
+			}
+
+			if (touched)
+				depth[row + x] = std::max(depth[row + x], t.depth_a * px + t.depth_b * py + t.depth_c);
+			if (inside)
+				coverage[row + x] = -1;
+		}
+	}
+}
+
+#endif
+
+void occlusion_culler::rasterize_inner(screen_triangle const & t, occluder_tile const & tile, float * depth)
+{
+	float inner[3];
+	for (int k = 0; k < 3; ++k)
+		inner[k] = 0.5f * (std::abs(t.edge_a[k]) + std::abs(t.edge_b[k]));
+
+	for (int y = t.min_y; y <= t.max_y; ++y)
+	{
+		float const py = y + 0.5f;
+		std::size_t const row = std::size_t(y - tile.min_y) * tile.width - tile.min_x;
+
+		for (int x = t.min_x; x <= t.max_x; ++x)
+		{
+			float const px = x + 0.5f;
+
+			bool inside = true;
+			for (int k = 0; k < 3; ++k)
+				inside = inside && (t.edge_a[k] * px + t.edge_b[k] * py + t.edge_c[k] >= inner[k]);
+
+			if (inside)
+				depth[row + x] = std::min(depth[row + x], t.depth_a * px + t.depth_b * py + t.depth_c);
+		}
+	}
+}
+
+void occlusion_culler::rasterize_edge(glm::vec2 a, glm::vec2 b, occluder_tile const & tile, std::uint32_t * coverage)
+{
+	if (a.y > b.y)
+		std::swap(a, b);
+
+	int const tile_max_x = tile.min_x + tile.width - 1;
+	int const min_y = std::max(tile.min_y, int(std::floor(a.y)));
+	int const max_y = std::min(tile.max_y, int(std::floor(b.y)));
+
+	for (int y = min_y; y <= max_y; ++y)
+	{
+		// The part of the segment within the row crosses the pixels its horizontal extent overlaps
+		float const t0 = (b.y > a.y) ? std::clamp((y - a.y) / (b.y - a.y), 0.f, 1.f) : 0.f;
+		float const t1 = (b.y > a.y) ? std::clamp((y + 1 - a.y) / (b.y - a.y), 0.f, 1.f) : 1.f;
+		float const x0 = a.x + (b.x - a.x) * t0;
+		float const x1 = a.x + (b.x - a.x) * t1;
+
+		int const min_x = std::max(tile.min_x, int(std::floor(std::min(x0, x1))));
+		int const max_x = std::min(tile_max_x, int(std::floor(std::max(x0, x1))));
+
+		std::size_t const row = std::size_t(y - tile.min_y) * tile.width - tile.min_x;
+		for (int x = min_x; x <= max_x; ++x)
+			coverage[row + x] = 0;
+	}
+}
+
+void occlusion_culler::render(thread_pool & pool)
+{
+	workers.resize(std::max<std::size_t>(workers.size(), pool.thread_count()));
+	for (auto & w : workers)
+	{
+		w.tiles.clear();
+		w.depths.clear();
+		w.triangle_count = 0;
+	}
+
+	pool.parallel_for(occluders.size(), 1, [&](std::size_t begin, std::size_t end, unsigned int worker)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+			setup(occluders[i], workers[worker]);
+	});
+
+	// Bands own disjoint rows, so they merge the tiles into the depth buffer without synchronization
+	int const band_count = (height_ + band_height - 1) / band_height;
+	pool.parallel_for(band_count, 1, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t band = begin; band < end; ++band)
+		{
+			int const min_y = band * band_height;
+			int const max_y = std::min<int>(min_y + band_height, height_) - 1;
+
+			for (auto const & w : workers)
+				for (auto const & tile : w.tiles)
+					for (int y = std::max(min_y, tile.min_y); y <= std::min(max_y, tile.max_y); ++y)
+						merge_row(pyramid[0].data() + std::size_t(y) * width_ + tile.min_x,
+							w.depths.data() + tile.offset + std::size_t(y - tile.min_y) * tile.width, tile.width);
+		}
+	});
+
+	for (std::size_t level = 1; level < pyramid.size(); ++level)
+	{
+		int const w = level_width[level], h = level_height[level];
+		int const pw = level_width[level - 1], ph = level_height[level - 1];
+		float const * source = pyramid[level - 1].data();
+		float * target = pyramid[level].data();
+
+		for (int y = 0; y < h; ++y)
+		{
+			int const y0 = 2 * y, y1 = std::min(2 * y + 1, ph - 1);
+			for (int x = 0; x < w; ++x)
+			{
+				int const x0 = 2 * x, x1 = std::min(2 * x + 1, pw - 1);
+				target[y * w + x] = std::max(
+					std::max(source[y0 * pw + x0], source[y0 * pw + x1]),
+					std::max(source[y1 * pw + x0], source[y1 * pw + x1]));
+			}
+		}
+	}
+}
+
+bool occlusion_culler::visible(glm::vec3 const & min, glm::vec3 const & max) const
+{
+	glm::vec2 screen_min(std::numeric_limits<float>::infinity());
+	glm::vec2 screen_max(-std::numeric_limits<float>::infinity());
+	float nearest = 1.f;
+
+	for (int i = 0; i < 8; ++i)
+	{
+		glm::vec4 const corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z, 1.f);
+		glm::vec4 const clip = view_projection * corner;
+		if (clip.z < -clip.w || clip.w <= 0.f)
+			return true;
+
+		glm::vec3 const ndc = glm::vec3(clip) / clip.w;
+		screen_min = glm::min(screen_min, glm::vec2(ndc));
+		screen_max = glm::max(screen_max, glm::vec2(ndc));
+		nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+	}
+
+	int const x0 = std::max(0, int(std::floor((screen_min.x * 0.5f + 0.5f) * width_)));
+	int const x1 = std::min(width_ - 1, int(std::floor((screen_max.x * 0.5f + 0.5f) * width_)));
+	int const y0 = std::max(0, int(std::floor((screen_min.y * 0.5f + 0.5f) * height_)));
+	int const y1 = std::min(height_ - 1, int(std::floor((screen_max.y * 0.5f + 0.5f) * height_)));
+	if (x0 > x1 || y0 > y1)
+		return false;
+
+	// Pick the level where the rectangle spans at most two or three texels per axis
+	int const size = std::max(x1 - x0, y1 - y0) + 1;
+	int level = 0;
+	while ((1 << (level + 1)) < size && level + 1 < int(pyramid.size()))
+		++level;
+
+	int const w = level_width[level];
+	float const * depth = pyramid[level].data();
+	for (int y = y0 >> level; y <= (y1 >> level); ++y)
+		for (int x = x0 >> level; x <= (x1 >> level); ++x)
+			if (nearest <= depth[y * w + x])
+				return true;
+
+	return false;
+}
+
+void occlusion_culler::test(thread_pool & pool, glm::vec3 const * min, glm::vec3 const * max, std::size_t count, std::uint8_t * visible) const
+{
+	pool.parallel_for(count, 256, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+			visible[i] = this->visible(min[i], max[i]);
+	});
+}
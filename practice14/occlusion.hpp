@@ -0,0 +1,141 @@
+#pragma once
+
+#include "aligned_allocator.hpp"
+#include "thread_pool.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Occluder geometry shared by all of its instances: welded triangles with edge adjacency,
+// used to find the silhouette edges of an occluder, along which pixels are only partly covered
+struct occluder_mesh
+{
+	static constexpr std::uint32_t no_neighbour = -1;
+
+	std::vector<glm::vec3> positions;
+	std::vector<std::uint32_t> indices;
+	// Triangle across edge (k, k + 1) of every triangle, or no_neighbour for open and non-manifold edges
+	std::vector<std::uint32_t> neighbours;
+
+	occluder_mesh(glm::vec3 const * positions, std::uint16_t const * indices, std::size_t index_count);
+	occluder_mesh(glm::vec3 const * positions, std::uint32_t const * indices, std::size_t index_count);
+
+	std::size_t triangle_count() const
+	{
+		return indices.size() / 3;
+	}
+};
+
+// Software occlusion culling: occluder meshes are rasterized into a small depth buffer,
+// which is then reduced into a pyramid of farthest depths to test boxes against.
+// Depth is window-space [0, 1] with 1 at the far plane, as in the default OpenGL depth range
+struct occlusion_culler
+{
+	// width is rounded up to a multiple of 8 pixels
+	occlusion_culler(int width, int height);
+
+	int width() const
+	{
+		return width_;
+	}
+
+	int height() const
+	{
+		return height_;
+	}
+
+	// Clears the depth buffer and the occluder list for a new frame
+	void begin(glm::mat4 const & view_projection);
+
+	// The mesh must stay alive until render() returns
+	void add_occluder(glm::mat4 const & model, occluder_mesh const & mesh);
+
+	// Transforms, culls back faces and clips occluders, rasterizes each of them into a tile of its own,
+	// merges the tiles in horizontal bands and builds the depth pyramid. A tile keeps the pixels the
+	// occluder covers entirely, at the farthest depth of any front face over the pixel. Only front
+	// faces are drawn, so occluders must be closed meshes with counter-clockwise front faces; open
+	// edges are treated as silhouettes
+	void render(thread_pool & pool);
+
+	// False only if the box is entirely behind the occluders or off screen; boxes crossing
+	// the near plane are always visible
+	bool visible(glm::vec3 const & min, glm::vec3 const & max) const;
+
+	void test(thread_pool & pool, glm::vec3 const * min, glm::vec3 const * max, std::size_t count, std::uint8_t * visible) const;
+
+	std::size_t triangle_count() const;
+
+	// Level 0 is the depth buffer itself, width() x height() floats
+	float const * depth(int level = 0) const
+	{
+		return pyramid[level].data();
+	}
+
+private:
+	struct occluder
+	{
+		glm::mat4 transform;
+		occluder_mesh const * mesh;
+	};
+
+	// Edge functions a * x + b * y + c >= 0 inside, and the depth plane offset to its farthest
+	// value over a pixel, in pixel coordinates
+	struct screen_triangle
+	{
+		float edge_a[3], edge_b[3], edge_c[3];
+		float depth_a, depth_b, depth_c;
+		int min_x, max_x, min_y, max_y;
+	};
+
+	// Depths of the pixels around one occluder, rows min_y to max_y of width pixels from min_x,
+	// both multiples of 8; pixels the occluder doesn't cover entirely are at the far plane
+	struct occluder_tile
+	{
+		int min_x, width, min_y, max_y;
+		std::size_t offset;
+	};
+
+	struct setup_scratch
+	{
+		std::vector<glm::vec4> clip;
+		std::vector<glm::vec3> window;
+		std::vector<std::uint8_t> front;
+		// Front faces and the pieces of faces crossing the near plane of the current occluder,
+		// and its silhouette edges as pairs of endpoints
+		std::vector<screen_triangle> triangles;
+		std::vector<screen_triangle> clipped;
+		std::vector<glm::vec2> silhouette;
+		// Pixels of the current tile whose centre is covered and that no silhouette edge crosses
+		aligned_vector<std::uint32_t> coverage;
+
+		// Tiles of all occluders set up by this worker in the frame
+		std::vector<occluder_tile> tiles;
+		aligned_vector<float> depths;
+		std::size_t triangle_count = 0;
+	};
+
+	void setup(occluder const & o, setup_scratch & scratch) const;
+	// Pixel coordinates and window-space depth
+	glm::vec3 window(glm::vec4 const & clip) const;
+	void setup_triangle(glm::vec3 const * v, std::vector<screen_triangle> & output) const;
+	// Raises the depth of every pixel the triangle touches to its farthest depth there, and marks the pixels whose centre it covers
+	static void rasterize(screen_triangle const & t, occluder_tile const & tile, float * depth, std::uint32_t * coverage);
+	// Lowers the depth of the pixels entirely inside the triangle
+	static void rasterize_inner(screen_triangle const & t, occluder_tile const & tile, float * depth);
+	// Clears the coverage of every pixel the segment crosses
+	static void rasterize_edge(glm::vec2 a, glm::vec2 b, occluder_tile const & tile, std::uint32_t * coverage);
+
+	int width_;
+	int height_;
+	glm::mat4 view_projection;
+
+	std::vector<occluder> occluders;
+	std::vector<setup_scratch> workers;
+
+	std::vector<int> level_width;
+	std::vector<int> level_height;
+	std::vector<aligned_vector<float>> pyramid;
+};
@@ -0,0 +1,108 @@
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <limits>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include "software_rasterizer.hpp"
+#include "image_writer.hpp"
+#include "thread_pool.hpp"
+#include "obj_parser.hpp"
+#include "gltf_loader.hpp"
+
+// Renders a model headlessly with the software rasterizer:
+//   render <model.obj|model.gltf> <output.png|output.ppm> [hemisphere|ambient|phong] [width height] [threads] [mesh]
+// glTF node transforms are not applied; mesh picks a single glTF mesh, e.g. one level of detail of the bunny
+int main(int argc, char ** argv) try
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <model.obj|model.gltf> <output.png|output.ppm> [hemisphere|ambient|phong] [width height] [threads] [mesh]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::path const model_path = argv[1];
+    std::filesystem::path const output_path = argv[2];
+
+    lighting light;
+    if (argc > 3)
+    {
+        std::string const model = argv[3];
+        if (model == "hemisphere")
+            light.model = shading_model::hemisphere;
+        else if (model == "ambient")
+            light.model = shading_model::ambient;
+        else if (model == "phong")
+            light.model = shading_model::phong;
+        else
+            throw std::runtime_error("Unknown shading model " + model);
+    }
+
+    int const width = argc > 5 ? std::stoi(argv[4]) : 1280;
+    int const height = argc > 5 ? std::stoi(argv[5]) : 720;
+    unsigned int const threads = argc > 6 ? std::stoi(argv[6]) : std::thread::hardware_concurrency();
+    int const mesh_index = argc > 7 ? std::stoi(argv[7]) : -1;
+
+    std::vector<std::unique_ptr<raster_mesh>> meshes;
+    if (model_path.extension() == ".obj")
+        meshes.push_back(std::make_unique<raster_mesh>(parse_obj(model_path)));
+    else
+    {
+        auto const model = load_gltf(model_path);
+        for (std::size_t i = 0; i < model.meshes.size(); ++i)
+            if (mesh_index < 0 || i == std::size_t(mesh_index))
+                meshes.push_back(std::make_unique<raster_mesh>(model, model.meshes[i]));
+        if (meshes.empty())
+            throw std::runtime_error("No mesh " + std::to_string(mesh_index) + " in " + model_path.string());
+    }
+
+    glm::vec3 min(std::numeric_limits<float>::infinity());
+    glm::vec3 max(-std::numeric_limits<float>::infinity());
+    for (auto const & mesh : meshes)
+        for (auto const & p : mesh->positions)
+        {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+
+    // Look at the model from above and in front, far enough to fit its bounding sphere
+    glm::vec3 const center = (min + max) * 0.5f;
+    float const radius = glm::length(max - min) * 0.5f;
+    float const fov = glm::pi<float>() / 3.f;
+    float const distance = radius / std::sin(fov * 0.5f);
+    glm::vec3 const eye = center + distance * glm::normalize(glm::vec3(0.f, 0.5f, 1.f));
+
+    glm::mat4 const view = glm::lookAt(eye, center, {0.f, 1.f, 0.f});
+    glm::mat4 const projection = glm::perspective(fov, float(width) / height, distance * 0.01f, distance * 2.f);
+
+    thread_pool pool(threads);
+    software_rasterizer rasterizer(width, height);
+
+    rasterizer.begin(view, projection, {0.8f, 0.8f, 0.9f});
+    for (auto const & mesh : meshes)
+        rasterizer.draw(glm::mat4(1.f), *mesh);
+
+    auto const start = std::chrono::high_resolution_clock::now();
+    rasterizer.render(pool, light);
+    auto const end = std::chrono::high_resolution_clock::now();
+
+    write_image(output_path, width, height, rasterizer.color().data());
+
+    std::cout << "Rendered " << rasterizer.triangle_count() << " triangles at " << width << "x" << height << " with "
+        << pool.thread_count() << " threads in " << std::chrono::duration<double, std::milli>(end - start).count()
+        << " ms to " << output_path.string() << std::endl;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,537 @@
+#include "software_rasterizer.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/exponential.hpp>
+#include <glm/matrix.hpp>
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+	// Pixels per tile side, a multiple of 8
+	constexpr int tile_size = 32;
+
+	// Triangles set up by one task
+	constexpr std::size_t setup_chunk = 1024;
+	constexpr std::size_t vertex_chunk = 4096;
+
+	constexpr unsigned int gl_unsigned_short = 0x1403;
+	constexpr unsigned int gl_unsigned_int = 0x1405;
+
+	std::uint32_t pack_color(glm::vec3 const & color)
+	{
+		glm::vec3 const c = glm::clamp(color, 0.f, 1.f) * 255.f + 0.5f;
+		return std::uint32_t(c.r) | (std::uint32_t(c.g) << 8) | (std::uint32_t(c.b) << 16) | (255u << 24);
+	}
+
+	glm::vec3 shade_pixel(lighting const & light, glm::vec3 const & albedo, glm::vec3 const & position, glm::vec3 const & normal,
+		glm::vec3 const & camera_position)
+	{
+		switch (light.model)
+		{
+		case shading_model::hemisphere:
+		{
+			glm::vec3 const ambient_dir{0.f, 1.f, 0.f};
+			glm::vec3 const ambient_color{0.2f};
+			glm::vec3 const light1_dir = glm::normalize(glm::vec3( 3.f, 2.f,  1.f));
+			glm::vec3 const light2_dir = glm::normalize(glm::vec3(-3.f, 2.f, -1.f));
+			glm::vec3 const light1_color{1.f,  0.5f, 0.25f};
+			glm::vec3 const light2_color{0.25f, 0.5f, 1.f };
+
+			glm::vec3 const color = (0.5f + 0.5f * glm::dot(normal, ambient_dir)) * ambient_color
+				+ std::max(0.f, glm::dot(normal, light1_dir)) * light1_color
+				+ std::max(0.f, glm::dot(normal, light2_dir)) * light2_color;
+			return glm::pow(glm::min(glm::vec3(1.f), color), glm::vec3(1.f / 2.2f));
+		}
+		case shading_model::ambient:
+			return albedo * light.ambient_light;
+		case shading_model::phong:
+		{
+			glm::vec3 const & direction = light.sun_direction;
+			glm::vec3 const diffuse = albedo * std::max(0.f, glm::dot(normal, direction));
+			glm::vec3 const reflected_direction = 2.f * normal * glm::dot(normal, direction) - direction;
+			glm::vec3 const view_direction = glm::normalize(camera_position - position);
+			glm::vec3 const specular = albedo * std::pow(std::max(0.f, glm::dot(reflected_direction, view_direction)), 64.f);
+			return albedo * light.ambient_light + light.sun_color * (diffuse + specular);
+		}
+		}
+		return albedo;
+	}
+
+	// Bit per clip plane the point is outside of
+	int outcode(glm::vec4 const & c)
+	{
+		return (c.x < -c.w) | ((c.x > c.w) << 1) | ((c.y < -c.w) << 2) | ((c.y > c.w) << 3) | ((c.z < -c.w) << 4) | ((c.z > c.w) << 5);
+	}
+
+	void compute_bounds(std::vector<glm::vec3> const & positions, glm::vec3 & min, glm::vec3 & max)
+	{
+		min = glm::vec3(std::numeric_limits<float>::infinity());
+		max = -min;
+		for (auto const & p : positions)
+		{
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+	}
+
+	template <typename Index>
+	void copy_indices(char const * data, std::size_t count, std::vector<std::uint32_t> & indices)
+	{
+		auto const source = reinterpret_cast<Index const *>(data);
+		indices.assign(source, source + count);
+	}
+
+}
+
+raster_mesh::raster_mesh(obj_data const & data)
+	: indices(data.indices)
+{
+	positions.reserve(data.vertices.size());
+	normals.reserve(data.vertices.size());
+	for (auto const & v : data.vertices)
+	{
+		positions.emplace_back(v.position[0], v.position[1], v.position[2]);
+		normals.emplace_back(v.normal[0], v.normal[1], v.normal[2]);
+	}
+	compute_bounds(positions, min, max);
+}
+
+raster_mesh::raster_mesh(gltf_model const & model, gltf_model::mesh const & mesh)
+	: two_sided(mesh.material.two_sided)
+{
+	auto const position_data = reinterpret_cast<glm::vec3 const *>(model.buffer.data() + mesh.position.view.offset);
+	auto const normal_data = reinterpret_cast<glm::vec3 const *>(model.buffer.data() + mesh.normal.view.offset);
+	positions.assign(position_data, position_data + mesh.position.count);
+	normals.assign(normal_data, normal_data + mesh.normal.count);
+
+	char const * index_data = model.buffer.data() + mesh.indices.view.offset;
+	if (mesh.indices.type == gl_unsigned_short)
+		copy_indices<std::uint16_t>(index_data, mesh.indices.count, indices);
+	else if (mesh.indices.type == gl_unsigned_int)
+		copy_indices<std::uint32_t>(index_data, mesh.indices.count, indices);
+	else
+		throw std::runtime_error("Unsupported index type in mesh " + mesh.name);
+
+	if (mesh.material.color)
+		albedo = glm::vec3(*mesh.material.color);
+	compute_bounds(positions, min, max);
+}
+
+software_rasterizer::software_rasterizer(int width, int height)
+	: width_(std::max(width, 1))
+	, height_(std::max(height, 1))
+	, stride((width_ + 7) & ~7)
+	, tiles_x((width_ + tile_size - 1) / tile_size)
+	, tiles_y((height_ + tile_size - 1) / tile_size)
+	, depth_(std::size_t(stride) * height_, 1.f)
+	, visibility(std::size_t(stride) * height_, no_triangle)
+	, color_(std::size_t(width_) * height_, 0)
+{}
+
+void software_rasterizer::begin(glm::mat4 const & view, glm::mat4 const & projection, glm::vec3 const & clear_color)
+{
+	this->view = view;
+	this->projection = projection;
+	this->clear_color = clear_color;
+	camera_position = glm::vec3(glm::inverse(view)[3]);
+
+	draws.clear();
+	vertex_count = 0;
+	draw_triangle_count = 0;
+}
+
+void software_rasterizer::draw(glm::mat4 const & model, raster_mesh const & mesh)
+{
+	// Outside if all corners of the bounds are beyond the same clip plane
+	glm::mat4 const transform = projection * view * model;
+	int outside = 0x3f;
+	for (int i = 0; i < 8; ++i)
+		outside &= outcode(transform * glm::vec4((i & 1) ? mesh.max.x : mesh.min.x, (i & 2) ? mesh.max.y : mesh.min.y, (i & 4) ? mesh.max.z : mesh.min.z, 1.f));
+	if (outside)
+		return;
+
+	draws.push_back({model, &mesh, vertex_count, draw_triangle_count});
+	vertex_count += mesh.positions.size();
+	draw_triangle_count += mesh.triangle_count();
+}
+
+std::size_t software_rasterizer::triangle_count() const
+{
+	std::size_t result = 0;
+	for (auto const & w : workers)
+		result += w.triangles.size();
+	return result;
+}
+
+void software_rasterizer::setup(draw_call const & d, std::size_t begin, std::size_t end, setup_scratch & scratch) const
+{
+	auto const & mesh = *d.mesh;
+	glm::vec4 const * clip = clip_positions.data() + d.vertex_offset;
+	vertex_attributes const * attribute = attributes.data() + d.vertex_offset;
+
+	auto in_front = [](glm::vec4 const & v){ return v.z >= -v.w; };
+
+	for (std::size_t t = begin; t < end; ++t)
+	{
+		std::uint32_t const i0 = mesh.indices[3 * t + 0];
+		std::uint32_t const i1 = mesh.indices[3 * t + 1];
+		std::uint32_t const i2 = mesh.indices[3 * t + 2];
+		glm::vec4 const c[3] = {clip[i0], clip[i1], clip[i2]};
+
+		// Triangles entirely outside one side of the frustum would only be clamped away later
+		int outside = 0x3f;
+		for (int k = 0; k < 3; ++k)
+			outside &= outcode(c[k]);
+		if (outside)
+			continue;
+
+		int inside = 0;
+		for (int k = 0; k < 3; ++k)
+			inside += in_front(c[k]);
+
+		if (inside == 0)
+			continue;
+
+		// With every w positive, the sign of det(xyw) is the winding on screen, so back faces are
+		// dropped before their attributes are fetched
+		if (inside == 3 && !mesh.two_sided && glm::determinant(glm::mat3(glm::vec3(c[0].x, c[0].y, c[0].w),
+			glm::vec3(c[1].x, c[1].y, c[1].w), glm::vec3(c[2].x, c[2].y, c[2].w))) <= 0.f)
+			continue;
+
+		clip_vertex const v[3] = {{c[0], attribute[i0]}, {c[1], attribute[i1]}, {c[2], attribute[i2]}};
+		std::uint32_t const order = 2 * (d.triangle_offset + t);
+
+		if (inside == 3)
+		{
+			setup_triangle(v, mesh, order, scratch);
+			continue;
+		}
+
+		// Clip against the near plane, which yields a triangle or a quad
+		clip_vertex polygon[4];
+		int size = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			auto const & a = v[k];
+			auto const & b = v[(k + 1) % 3];
+			float const da = a.clip.z + a.clip.w;
+			float const db = b.clip.z + b.clip.w;
+
+			if (da >= 0.f)
+				polygon[size++] = a;
+			if ((da >= 0.f) != (db >= 0.f))
+			{
+				float const f = da / (da - db);
+				polygon[size++] = {glm::mix(a.clip, b.clip, f),
+					{glm::mix(a.attributes.position, b.attributes.position, f), glm::mix(a.attributes.normal, b.attributes.normal, f)}};
+			}
+		}
+
+		setup_triangle(polygon, mesh, order, scratch);
+		if (size == 4)
+		{
+			clip_vertex const second[3] = {polygon[0], polygon[2], polygon[3]};
+			setup_triangle(second, mesh, order + 1, scratch);
+		}
+	}
+}
+
+void software_rasterizer::setup_triangle(clip_vertex const * clip, raster_mesh const & mesh, std::uint32_t order, setup_scratch & scratch) const
+{
+	screen_triangle t;
+
+	glm::vec3 v[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		t.inverse_w[k] = 1.f / clip[k].clip.w;
+		glm::vec3 const ndc = glm::vec3(clip[k].clip) * t.inverse_w[k];
+		v[k] = {(ndc.x * 0.5f + 0.5f) * width_, (ndc.y * 0.5f + 0.5f) * height_, ndc.z * 0.5f + 0.5f};
+		t.position[k] = clip[k].attributes.position;
+		t.normal[k] = clip[k].attributes.normal;
+	}
+
+	float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+	if (area < 0.f && mesh.two_sided)
+	{
+		// Flip the winding so that the same edge functions work for back faces
+		std::swap(v[1], v[2]);
+		std::swap(t.inverse_w[1], t.inverse_w[2]);
+		std::swap(t.position[1], t.position[2]);
+		std::swap(t.normal[1], t.normal[2]);
+		area = -area;
+	}
+
+	// Back faces and degenerate triangles are skipped
+	if (area < 1e-8f)
+		return;
+
+	t.min_x = std::max(0, int(std::floor(std::min({v[0].x, v[1].x, v[2].x}))));
+	t.max_x = std::min(width_ - 1, int(std::ceil(std::max({v[0].x, v[1].x, v[2].x}))));
+	t.min_y = std::max(0, int(std::floor(std::min({v[0].y, v[1].y, v[2].y}))));
+	t.max_y = std::min(height_ - 1, int(std::ceil(std::max({v[0].y, v[1].y, v[2].y}))));
+	if (t.min_x > t.max_x || t.min_y > t.max_y)
+		return;
+
+	for (int k = 0; k < 3; ++k)
+	{
+		auto const & a = v[k];
+		auto const & b = v[(k + 1) % 3];
+		t.edge_a[k] = a.y - b.y;
+		t.edge_b[k] = b.x - a.x;
+		t.edge_c[k] = a.x * b.y - a.y * b.x;
+	}
+
+	// Window-space depth is affine in screen space, unlike the other attributes
+	float const dx1 = v[1].x - v[0].x, dy1 = v[1].y - v[0].y, dz1 = v[1].z - v[0].z;
+	float const dx2 = v[2].x - v[0].x, dy2 = v[2].y - v[0].y, dz2 = v[2].z - v[0].z;
+	t.depth_a = (dz1 * dy2 - dz2 * dy1) / area;
+	t.depth_b = (dz2 * dx1 - dz1 * dx2) / area;
+	t.depth_c = v[0].z - t.depth_a * v[0].x - t.depth_b * v[0].y;
+
+	t.inverse_area = 1.f / area;
+	t.albedo = mesh.albedo;
+	t.order = order;
+
+	std::uint32_t const index = scratch.triangles.size();
+	scratch.triangles.push_back(t);
+
+	for (int ty = t.min_y / tile_size; ty <= t.max_y / tile_size; ++ty)
+		for (int tx = t.min_x / tile_size; tx <= t.max_x / tile_size; ++tx)
+			scratch.bins[ty * tiles_x + tx].push_back(index);
+}
+
+#ifdef __AVX__
+
+void software_rasterizer::rasterize(screen_triangle const & t, std::uint32_t reference, int min_x, int max_x, int min_y, int max_y)
+{
+	__m256 a[3], b[3], c[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		a[k] = _mm256_set1_ps(t.edge_a[k]);
+		b[k] = _mm256_set1_ps(t.edge_b[k]);
+		c[k] = _mm256_set1_ps(t.edge_c[k]);
+	}
+
+	__m256 const depth_a = _mm256_set1_ps(t.depth_a);
+	__m256 const depth_b = _mm256_set1_ps(t.depth_b);
+	__m256 const depth_c = _mm256_set1_ps(t.depth_c);
+	__m256 const offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	__m256 const zero = _mm256_setzero_ps();
+	__m256 const id = _mm256_castsi256_ps(_mm256_set1_epi32(reference));
+
+	for (int y = std::max(min_y, t.min_y); y <= std::min(max_y, t.max_y); ++y)
+	{
+		__m256 const py = _mm256_set1_ps(y + 0.5f);
+		float * depth_row = depth_.data() + std::size_t(y) * stride;
+		std::uint32_t * visibility_row = visibility.data() + std::size_t(y) * stride;
+
+		for (int x = std::max(min_x, t.min_x) & ~7; x <= std::min(max_x, t.max_x); x += 8)
+		{
+			__m256 const px = _mm256_add_ps(_mm256_set1_ps(float(x)), offsets);
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int k = 0; k < 3; ++k)
+			{
+				__m256 const e = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[k], px), _mm256_mul_ps(b[k], py)), c[k]);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(e, zero, _CMP_GE_OQ));
+			}
+
+			if (_mm256_movemask_ps(inside) == 0)
+				continue;
+
+			__m256 const depth = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(depth_a, px), _mm256_mul_ps(depth_b, py)), depth_c);
+			__m256 const current = _mm256_load_ps(depth_row + x);
+			__m256 closer = _mm256_and_ps(inside, _mm256_cmp_ps(depth, current, _CMP_LT_OQ));
+
+			// Equal depths go to the triangle drawn first, whichever thread set it up
+			if (int ties = _mm256_movemask_ps(_mm256_and_ps(inside, _mm256_cmp_ps(depth, current, _CMP_EQ_OQ))))
+			{
+				alignas(32) std::uint32_t lanes[8];
+				_mm256_store_ps(reinterpret_cast<float *>(lanes), closer);
+				for (int i = 0; i < 8; ++i)
+					if ((ties & (1 << i)) && (visibility_row[x + i] == no_triangle || t.order < triangle(visibility_row[x + i]).order))
+						lanes[i] = -1;
+				closer = _mm256_load_ps(reinterpret_cast<float const *>(lanes));
+			}
+
+			_mm256_store_ps(depth_row + x, _mm256_blendv_ps(current, depth, closer));
+			float * ids = reinterpret_cast<float *>(visibility_row + x);
+			_mm256_store_ps(ids, _mm256_blendv_ps(_mm256_load_ps(ids), id, closer));
+		}
+	}
+}
+
+#else
+
+void software_rasterizer::rasterize(screen_triangle const & t, std::uint32_t reference, int min_x, int max_x, int min_y, int max_y)
+{
+	for (int y = std::max(min_y, t.min_y); y <= std::min(max_y, t.max_y); ++y)
+	{
+		float const py = y + 0.5f;
+		float * depth_row = depth_.data() + std::size_t(y) * stride;
+		std::uint32_t * visibility_row = visibility.data() + std::size_t(y) * stride;
+
+		for (int x = std::max(min_x, t.min_x); x <= std::min(max_x, t.max_x); ++x)
+		{
+			float const px = x + 0.5f;
+
+			bool inside = true;
+			for (int k = 0; k < 3; ++k)
+				inside = inside && (t.edge_a[k] * px + t.edge_b[k] * py + t.edge_c[k] >= 0.f);
+
+			if (!inside)
+				continue;
+
+			// Equal depths go to the triangle drawn first, whichever thread set it up
+			float const depth = t.depth_a * px + t.depth_b * py + t.depth_c;
+			bool const closer = depth < depth_row[x]
+				|| (depth == depth_row[x] && (visibility_row[x] == no_triangle || t.order < triangle(visibility_row[x]).order));
+
+			if (closer)
+			{
+				depth_row[x] = depth;
+				visibility_row[x] = reference;
+			}
+		}
+	}
+}
+
+#endif
+
+void software_rasterizer::shade(int min_x, int max_x, int min_y, int max_y, lighting const & light)
+{
+	std::uint32_t const background = pack_color(clear_color);
+
+	for (int y = min_y; y <= max_y; ++y)
+	{
+		float const py = y + 0.5f;
+		std::uint32_t const * visibility_row = visibility.data() + std::size_t(y) * stride;
+		std::uint32_t * color_row = color_.data() + std::size_t(y) * width_;
+
+		for (int x = min_x; x <= max_x; ++x)
+		{
+			if (visibility_row[x] == no_triangle)
+			{
+				color_row[x] = background;
+				continue;
+			}
+
+			auto const & t = triangle(visibility_row[x]);
+			float const px = x + 0.5f;
+
+			// Screen-space barycentrics weighted by 1/w interpolate linearly in world space
+			float weights[3];
+			for (int k = 0; k < 3; ++k)
+				weights[(k + 2) % 3] = (t.edge_a[k] * px + t.edge_b[k] * py + t.edge_c[k]) * t.inverse_area * t.inverse_w[(k + 2) % 3];
+			float const normalization = 1.f / (weights[0] + weights[1] + weights[2]);
+
+			glm::vec3 position(0.f), normal(0.f);
+			for (int k = 0; k < 3; ++k)
+			{
+				position += t.position[k] * (weights[k] * normalization);
+				normal += t.normal[k] * (weights[k] * normalization);
+			}
+
+			color_row[x] = pack_color(shade_pixel(light, t.albedo, position, glm::normalize(normal), camera_position));
+		}
+	}
+}
+
+void software_rasterizer::render(thread_pool & pool, lighting const & light)
+{
+	std::size_t const tile_count = std::size_t(tiles_x) * tiles_y;
+
+	workers.resize(std::max<std::size_t>(workers.size(), pool.thread_count()));
+	for (auto & w : workers)
+	{
+		w.triangles.clear();
+		w.bins.resize(tile_count);
+		for (auto & bin : w.bins)
+			bin.clear();
+	}
+
+	// Calls f(draw, begin, end) for the parts of [begin, end) falling into each draw, in units of offset_of and size_of
+	auto for_each_draw = [&](std::size_t begin, std::size_t end, auto offset_of, auto size_of, auto && f)
+	{
+		auto d = std::upper_bound(draws.begin(), draws.end(), begin, [&](std::size_t i, draw_call const & d){ return i < offset_of(d); }) - 1;
+		for (; begin < end; ++d)
+		{
+			std::size_t const draw_end = std::min(end, offset_of(*d) + size_of(*d));
+			if (begin < draw_end)
+				f(*d, begin - offset_of(*d), draw_end - offset_of(*d));
+			begin = std::max(begin, draw_end);
+		}
+	};
+
+	clip_positions.resize(vertex_count);
+	attributes.resize(vertex_count);
+	pool.parallel_for(vertex_count, vertex_chunk, [&](std::size_t begin, std::size_t end)
+	{
+		for_each_draw(begin, end,
+			[](draw_call const & d){ return d.vertex_offset; },
+			[](draw_call const & d){ return d.mesh->positions.size(); },
+			[&](draw_call const & d, std::size_t first, std::size_t last)
+			{
+				glm::mat4 const transform = projection * view * d.model;
+				glm::mat3 const normal_transform(d.model);
+				for (std::size_t i = first; i < last; ++i)
+				{
+					glm::vec4 const p(d.mesh->positions[i], 1.f);
+					clip_positions[d.vertex_offset + i] = transform * p;
+					attributes[d.vertex_offset + i] = {glm::vec3(d.model * p), glm::normalize(normal_transform * d.mesh->normals[i])};
+				}
+			});
+	});
+
+	pool.parallel_for(draw_triangle_count, setup_chunk, [&](std::size_t begin, std::size_t end, unsigned int worker)
+	{
+		for_each_draw(begin, end,
+			[](draw_call const & d){ return d.triangle_offset; },
+			[](draw_call const & d){ return d.mesh->triangle_count(); },
+			[&](draw_call const & d, std::size_t first, std::size_t last)
+			{
+				setup(d, first, last, workers[worker]);
+			});
+	});
+
+	for (auto const & w : workers)
+		if (w.triangles.size() >= (std::size_t(1) << worker_shift))
+			throw std::runtime_error("Too many triangles for the software rasterizer");
+
+	// Tiles own disjoint pixels, so they are cleared, rasterized and shaded without synchronization
+	pool.parallel_for(tile_count, 1, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t tile = begin; tile < end; ++tile)
+		{
+			int const min_x = (tile % tiles_x) * tile_size;
+			int const min_y = (tile / tiles_x) * tile_size;
+			int const max_x = std::min(min_x + tile_size, width_) - 1;
+			int const max_y = std::min(min_y + tile_size, height_) - 1;
+
+			// Up to the padded row end, which the vector path may touch
+			int const clear_end = std::min(min_x + tile_size, stride);
+			for (int y = min_y; y <= max_y; ++y)
+			{
+				std::fill(depth_.begin() + std::size_t(y) * stride + min_x, depth_.begin() + std::size_t(y) * stride + clear_end, 1.f);
+				std::fill(visibility.begin() + std::size_t(y) * stride + min_x, visibility.begin() + std::size_t(y) * stride + clear_end, no_triangle);
+			}
+
+			for (std::size_t w = 0; w < workers.size(); ++w)
+				for (auto index : workers[w].bins[tile])
+					rasterize(workers[w].triangles[index], (w << worker_shift) | index, min_x, max_x, min_y, max_y);
+
+			shade(min_x, max_x, min_y, max_y, light);
+		}
+	});
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "aligned_allocator.hpp"
+#include "thread_pool.hpp"
+#include "obj_parser.hpp"
+#include "gltf_loader.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Lighting of the earlier practices, evaluated per pixel
+enum class shading_model : std::uint8_t
+{
+	// practice4: hemisphere ambient and two coloured directional lights, gamma corrected
+	hemisphere,
+	// practice7: ambient light only
+	ambient,
+	// practice8: ambient light and a Phong-lit sun
+	phong,
+};
+
+struct lighting
+{
+	shading_model model = shading_model::phong;
+	glm::vec3 ambient_light{0.2f};
+	glm::vec3 sun_direction{0.f, 0.894427f, 0.447214f};
+	glm::vec3 sun_color{1.f};
+};
+
+// Triangle mesh in the rasterizer's own format, shared by all of its instances
+struct raster_mesh
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<std::uint32_t> indices;
+	// Bounds of the positions
+	glm::vec3 min;
+	glm::vec3 max;
+	glm::vec3 albedo{0.8f, 0.7f, 0.6f};
+	// Back faces are culled unless set
+	bool two_sided = false;
+
+	explicit raster_mesh(obj_data const & data);
+	// Uses the material colour as albedo if there is one; textures are ignored
+	raster_mesh(gltf_model const & model, gltf_model::mesh const & mesh);
+
+	std::size_t triangle_count() const
+	{
+		return indices.size() / 3;
+	}
+};
+
+// Headless tile-based rasterizer. Triangles are set up and binned into tiles in parallel,
+// then every tile is rasterized into a depth and visibility buffer and shaded once per pixel.
+// Depth ties are broken by draw order, so the image does not depend on the thread count.
+// Conventions follow OpenGL: counter-clockwise front faces, clip-space z in [-w, w], row 0 at the bottom
+struct software_rasterizer
+{
+	software_rasterizer(int width, int height);
+
+	int width() const
+	{
+		return width_;
+	}
+
+	int height() const
+	{
+		return height_;
+	}
+
+	// Clears the draw list for a new frame
+	void begin(glm::mat4 const & view, glm::mat4 const & projection, glm::vec3 const & clear_color);
+
+	// The mesh must stay alive until render() returns. Draws whose bounds are outside the view are dropped here
+	void draw(glm::mat4 const & model, raster_mesh const & mesh);
+
+	void render(thread_pool & pool, lighting const & light);
+
+	// Triangles that reached the tiles in the last render(), after culling and clipping
+	std::size_t triangle_count() const;
+
+	// RGBA8 with red in the lowest byte, width() x height() pixels, bottom row first
+	std::vector<std::uint32_t> const & color() const
+	{
+		return color_;
+	}
+
+	// Window-space depth in [0, 1]
+	float depth(int x, int y) const
+	{
+		return depth_[std::size_t(y) * stride + x];
+	}
+
+private:
+	struct draw_call
+	{
+		glm::mat4 model;
+		raster_mesh const * mesh;
+		// Of the draw's vertices in the transformed vertex arrays, and of its first triangle in draw order
+		std::size_t vertex_offset;
+		std::size_t triangle_offset;
+	};
+
+	struct vertex_attributes
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+	};
+
+	struct clip_vertex
+	{
+		glm::vec4 clip;
+		vertex_attributes attributes;
+	};
+
+	// Edge k runs from vertex k to k + 1; a * x + b * y + c >= 0 inside, and divided by the doubled
+	// area it is the screen-space barycentric weight of vertex k + 2
+	struct screen_triangle
+	{
+		float edge_a[3], edge_b[3], edge_c[3];
+		float depth_a, depth_b, depth_c;
+		float inverse_area;
+		float inverse_w[3];
+		glm::vec3 position[3];
+		glm::vec3 normal[3];
+		glm::vec3 albedo;
+		// Triangle index in draw order times two, plus one for the second half of a clipped quad
+		std::uint32_t order;
+		int min_x, max_x, min_y, max_y;
+	};
+
+	struct setup_scratch
+	{
+		std::vector<screen_triangle> triangles;
+		// Indices into triangles overlapping every tile, in the order they were set up
+		std::vector<std::vector<std::uint32_t>> bins;
+	};
+
+	void setup(draw_call const & d, std::size_t begin, std::size_t end, setup_scratch & scratch) const;
+	void setup_triangle(clip_vertex const * v, raster_mesh const & mesh, std::uint32_t order, setup_scratch & scratch) const;
+	void rasterize(screen_triangle const & t, std::uint32_t reference, int min_x, int max_x, int min_y, int max_y);
+	void shade(int min_x, int max_x, int min_y, int max_y, lighting const & light);
+
+	// Visibility buffer entries are a worker index in the top byte and a triangle index in the rest
+	static constexpr std::uint32_t no_triangle = -1;
+	static constexpr int worker_shift = 24;
+
+	screen_triangle const & triangle(std::uint32_t reference) const
+	{
+		return workers[reference >> worker_shift].triangles[reference & ((1u << worker_shift) - 1)];
+	}
+
+	int width_;
+	int height_;
+	// Row pitch of the depth and visibility buffers, a multiple of 8 pixels
+	int stride;
+	int tiles_x;
+	int tiles_y;
+
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 camera_position;
+	glm::vec3 clear_color;
+
+	std::vector<draw_call> draws;
+	std::size_t vertex_count = 0;
+	std::size_t draw_triangle_count = 0;
+	// Transformed vertices of all draws; clip positions are kept apart since most triangles are culled using only them
+	std::vector<glm::vec4> clip_positions;
+	std::vector<vertex_attributes> attributes;
+	std::vector<setup_scratch> workers;
+
+	aligned_vector<float> depth_;
+	aligned_vector<std::uint32_t> visibility;
+	std::vector<std::uint32_t> color_;
+};
@@ -0,0 +1,86 @@
+#include "spatial_hash.hpp"
+
+#include <bit>
+
+spatial_hash::spatial_hash(float cell_size, std::size_t bucket_count, std::size_t capacity)
+	: inverse_cell_size(1.f / cell_size)
+	, buckets(std::bit_ceil(std::max<std::size_t>(bucket_count, 1)), none)
+{
+	objects.reserve(capacity);
+}
+
+spatial_hash::handle spatial_hash::insert(glm::vec3 const & min, glm::vec3 const & max)
+{
+	handle h;
+	if (free_list != none)
+	{
+		h = free_list;
+		free_list = objects[h].next;
+	}
+	else
+	{
+		h = objects.size();
+		objects.emplace_back();
+	}
+
+	auto & o = objects[h];
+	o.min = min;
+	o.max = max;
+	o.cell = cell_of((min + max) * 0.5f);
+	max_half_size = glm::max(max_half_size, (max - min) * 0.5f);
+
+	link(h);
+	++live_count;
+	return h;
+}
+
+void spatial_hash::move(handle h, glm::vec3 const & min, glm::vec3 const & max)
+{
+	auto & o = objects[h];
+	o.min = min;
+	o.max = max;
+	max_half_size = glm::max(max_half_size, (max - min) * 0.5f);
+
+	// Most moves stay inside the cell and leave the lists untouched
+	glm::ivec3 const cell = cell_of((min + max) * 0.5f);
+	if (cell == o.cell)
+		return;
+
+	unlink(h);
+	o.cell = cell;
+	link(h);
+}
+
+void spatial_hash::remove(handle h)
+{
+	unlink(h);
+
+	auto & o = objects[h];
+	o.bucket = none;
+	o.prev = none;
+	o.next = free_list;
+	free_list = h;
+	--live_count;
+}
+
+void spatial_hash::link(handle h)
+{
+	auto & o = objects[h];
+	o.bucket = bucket_of(o.cell);
+	o.prev = none;
+	o.next = buckets[o.bucket];
+	if (o.next != none)
+		objects[o.next].prev = h;
+	buckets[o.bucket] = h;
+}
+
+void spatial_hash::unlink(handle h)
+{
+	auto & o = objects[h];
+	if (o.prev != none)
+		objects[o.prev].next = o.next;
+	else
+		buckets[o.bucket] = o.next;
+	if (o.next != none)
+		objects[o.next].prev = o.prev;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "aabb.hpp"
+#include "frustum.hpp"
+#include "sphere.hpp"
+#include "culling.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/common.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Loose hashed grid for moving objects: an object is linked into the cell containing its centre,
+// and queries grow by the largest half size ever inserted, so any box fits regardless of where
+// it straddles cells. Objects and buckets are intrusive lists over preallocated arrays:
+// move() and remove() never allocate, insert() only when the object pool has to grow
+struct spatial_hash
+{
+	using handle = std::uint32_t;
+
+	// bucket_count is rounded up to a power of two; cell_size should be about the typical object size
+	spatial_hash(float cell_size, std::size_t bucket_count, std::size_t capacity = 0);
+
+	handle insert(glm::vec3 const & min, glm::vec3 const & max);
+	void move(handle h, glm::vec3 const & min, glm::vec3 const & max);
+	void remove(handle h);
+
+	std::size_t size() const
+	{
+		return live_count;
+	}
+
+	glm::vec3 const & min(handle h) const
+	{
+		return objects[h].min;
+	}
+
+	glm::vec3 const & max(handle h) const
+	{
+		return objects[h].max;
+	}
+
+	// Calls f(handle) for every object whose box intersects the query
+	template <typename F>
+	void query(aabb const & box, F && f) const;
+	template <typename F>
+	void query(sphere const & s, F && f) const;
+	template <typename F>
+	void query(frustum const & fr, F && f) const;
+
+private:
+	static constexpr std::uint32_t none = -1;
+
+	struct object
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+		glm::ivec3 cell;
+		std::uint32_t bucket = none;
+		// Neighbours in the bucket list, or in the free list for removed objects
+		std::uint32_t next = none;
+		std::uint32_t prev = none;
+	};
+
+	glm::ivec3 cell_of(glm::vec3 const & p) const
+	{
+		return glm::ivec3(glm::floor(p * inverse_cell_size));
+	}
+
+	std::uint32_t bucket_of(glm::ivec3 const & cell) const
+	{
+		return ((cell.x * 73856093u) ^ (cell.y * 19349663u) ^ (cell.z * 83492791u)) & (buckets.size() - 1);
+	}
+
+	void link(handle h);
+	void unlink(handle h);
+
+	// Calls f(handle) for objects linked into cells [min_cell, max_cell], falling back to
+	// a scan of all objects when the range spans more cells than there are objects
+	template <typename F>
+	void for_each_candidate(glm::vec3 const & min, glm::vec3 const & max, F && f) const;
+
+	float inverse_cell_size;
+	glm::vec3 max_half_size{0.f};
+
+	std::vector<object> objects;
+	std::vector<std::uint32_t> buckets;
+	std::uint32_t free_list = none;
+	std::size_t live_count = 0;
+};
+
+template <typename F>
+void spatial_hash::for_each_candidate(glm::vec3 const & min, glm::vec3 const & max, F && f) const
+{
+	glm::ivec3 const min_cell = cell_of(min - max_half_size);
+	glm::ivec3 const max_cell = cell_of(max + max_half_size);
+	glm::vec3 const cells = glm::vec3(max_cell - min_cell) + 1.f;
+
+	if (cells.x * cells.y * cells.z > float(live_count))
+	{
+		for (handle h = 0; h < objects.size(); ++h)
+			if (objects[h].bucket != none)
+				f(h);
+		return;
+	}
+
+	for (int z = min_cell.z; z <= max_cell.z; ++z)
+	{
+		for (int y = min_cell.y; y <= max_cell.y; ++y)
+		{
+			for (int x = min_cell.x; x <= max_cell.x; ++x)
+			{
+				glm::ivec3 const cell(x, y, z);
+				// Other cells may share the bucket; skipping them also avoids reporting an object twice
+				for (std::uint32_t h = buckets[bucket_of(cell)]; h != none; h = objects[h].next)
+					if (objects[h].cell == cell)
+						f(h);
+			}
+		}
+	}
+}
+
+template <typename F>
+void spatial_hash::query(aabb const & box, F && f) const
+{
+	for_each_candidate(box.min, box.max, [&](handle h)
+	{
+		auto const & o = objects[h];
+		if (glm::all(glm::lessThanEqual(o.min, box.max)) && glm::all(glm::lessThanEqual(box.min, o.max)))
+			f(h);
+	});
+}
+
+template <typename F>
+void spatial_hash::query(sphere const & s, F && f) const
+{
+	for_each_candidate(s.center - s.radius, s.center + s.radius, [&](handle h)
+	{
+		auto const & o = objects[h];
+		glm::vec3 const d = s.center - glm::clamp(s.center, o.min, o.max);
+		if (glm::dot(d, d) <= s.radius * s.radius)
+			f(h);
+	});
+}
+
+template <typename F>
+void spatial_hash::query(frustum const & fr, F && f) const
+{
+	glm::vec3 min = fr.vertices[0];
+	glm::vec3 max = fr.vertices[0];
+	for (auto const & v : fr.vertices)
+	{
+		min = glm::min(min, v);
+		max = glm::max(max, v);
+	}
+
+	for_each_candidate(min, max, [&](handle h)
+	{
+		if (classify(fr, objects[h].min, objects[h].max) != cull_result::outside)
+			f(h);
+	});
+}
@@ -0,0 +1,11 @@
+#include "sphere.hpp"
+
+sphere::sphere(glm::vec3 const & center, float radius)
+	: center(center)
+	, radius(radius)
+	, vertices{center}
+{}
+
+const std::array<glm::vec3, 0> sphere::face_normals = {};
+
+const std::array<glm::vec3, 0> sphere::edge_directions = {};
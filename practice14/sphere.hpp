@@ -0,0 +1,47 @@
+#pragma once
+
+#include "body_traits.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <array>
+
+// A sphere has no faces or edges; SAT tests it along the axes from its center to the
+// vertices of the other body instead. That is exact against a sphere or near faces and
+// vertices, and conservative (may report an intersection) near edges of the other body
+struct sphere
+{
+	sphere(glm::vec3 const & center, float radius);
+
+	glm::vec3 center;
+	float radius;
+
+	// The center stands in for the vertices when the other body builds its point axes
+	std::array<glm::vec3, 1> vertices;
+	static const std::array<glm::vec3, 0> face_normals;
+	static const std::array<glm::vec3, 0> edge_directions;
+};
+
+template <>
+struct body_traits<sphere>
+{
+	static constexpr bool axis_aligned = false;
+	static constexpr bool point_axes = true;
+
+	static glm::vec3 center(sphere const & b)
+	{
+		return b.center;
+	}
+
+	static std::pair<float, float> project(sphere const & b, glm::vec3 const & n)
+	{
+		float const center = glm::dot(b.center, n);
+		float const radius = b.radius * glm::length(n);
+		return {center - radius, center + radius};
+	}
+
+	static std::pair<float, float> project_cardinal(sphere const & b, int axis)
+	{
+		return {b.center[axis] - b.radius, b.center[axis] + b.radius};
+	}
+};
@@ -0,0 +1,481 @@
+#include "triangle_bvh.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TRIANGLE_BVH_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+
+	constexpr std::size_t bin_count = 16;
+	constexpr std::uint32_t max_leaf_size = 8;
+	constexpr std::size_t max_depth = 60;
+	// Ranges at most this large, or reaching parallel_depth, are built as separate tasks
+	constexpr std::uint32_t parallel_threshold = 4096;
+	constexpr std::size_t parallel_depth = 6;
+	// Marks a top-level node standing for a subtree built by a task; index is the task
+	constexpr std::uint32_t subtree_marker = -1;
+
+	constexpr float inf = std::numeric_limits<float>::infinity();
+
+	struct box
+	{
+		glm::vec3 min{inf};
+		glm::vec3 max{-inf};
+
+		void extend(box const & b)
+		{
+			min = glm::min(min, b.min);
+			max = glm::max(max, b.max);
+		}
+
+		void extend(glm::vec3 const & p)
+		{
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+
+		float area() const
+		{
+			glm::vec3 const d = glm::max(max - min, glm::vec3(0.f));
+			return d.x * d.y + d.y * d.z + d.z * d.x;
+		}
+	};
+
+	struct builder
+	{
+		std::vector<box> bounds;
+		std::vector<glm::vec3> centroids;
+		std::vector<std::uint32_t> order;
+
+		// Partitions order[begin, end) by the best binned SAH split and returns its position,
+		// or end if a leaf is cheaper
+		std::uint32_t split(std::uint32_t begin, std::uint32_t end, box & node_bounds)
+		{
+			box centroid_bounds;
+			for (std::uint32_t i = begin; i < end; ++i)
+			{
+				node_bounds.extend(bounds[order[i]]);
+				centroid_bounds.extend(centroids[order[i]]);
+			}
+
+			std::uint32_t const count = end - begin;
+			if (count <= 2)
+				return end;
+
+			glm::vec3 const extent = centroid_bounds.max - centroid_bounds.min;
+			int const axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z) ? 1 : 2;
+			if (extent[axis] <= 0.f)
+				return end;
+
+			float const scale = bin_count / extent[axis];
+			auto bin_of = [&](std::uint32_t t)
+			{
+				return std::min<std::size_t>(bin_count - 1, (centroids[t][axis] - centroid_bounds.min[axis]) * scale);
+			};
+
+			std::array<box, bin_count> bins;
+			std::array<std::uint32_t, bin_count> bin_sizes{};
+			for (std::uint32_t i = begin; i < end; ++i)
+			{
+				std::size_t const b = bin_of(order[i]);
+				bins[b].extend(bounds[order[i]]);
+				++bin_sizes[b];
+			}
+
+			std::array<float, bin_count> right_cost;
+			box right_box;
+			std::uint32_t right_size = 0;
+			for (std::size_t b = bin_count - 1; b > 0; --b)
+			{
+				right_box.extend(bins[b]);
+				right_size += bin_sizes[b];
+				right_cost[b] = right_box.area() * right_size;
+			}
+
+			float best_cost = inf;
+			std::size_t best_split = 0;
+			box left_box;
+			std::uint32_t left_size = 0;
+			for (std::size_t b = 1; b < bin_count; ++b)
+			{
+				left_box.extend(bins[b - 1]);
+				left_size += bin_sizes[b - 1];
+				if (left_size == 0 || left_size == count)
+					continue;
+
+				float const cost = left_box.area() * left_size + right_cost[b];
+				if (cost < best_cost)
+				{
+					best_cost = cost;
+					best_split = b;
+				}
+			}
+
+			if (best_split == 0)
+				return end;
+
+			// One traversal step costs about as much as one triangle test
+			if (count <= max_leaf_size && node_bounds.area() + best_cost >= node_bounds.area() * count)
+				return end;
+
+			auto const middle = std::partition(order.begin() + begin, order.begin() + end,
+				[&](std::uint32_t t){ return bin_of(t) < best_split; });
+			return middle - order.begin();
+		}
+
+		std::uint32_t build(std::uint32_t begin, std::uint32_t end, std::size_t depth, std::vector<triangle_bvh::node> & nodes)
+		{
+			box node_bounds;
+			std::uint32_t middle = end;
+			if (depth < max_depth)
+				middle = split(begin, end, node_bounds);
+			else
+				for (std::uint32_t i = begin; i < end; ++i)
+					node_bounds.extend(bounds[order[i]]);
+
+			std::uint32_t const index = nodes.size();
+			if (middle == end)
+			{
+				nodes.push_back({node_bounds.min, begin, node_bounds.max, end - begin});
+				return index;
+			}
+
+			nodes.push_back({node_bounds.min, 0, node_bounds.max, 0});
+			build(begin, middle, depth + 1, nodes);
+			nodes[index].index = build(middle, end, depth + 1, nodes);
+			return index;
+		}
+
+		struct task
+		{
+			std::uint32_t begin, end;
+			std::size_t depth;
+			std::vector<triangle_bvh::node> nodes;
+		};
+
+		// Same as build(), but leaves large ranges below the top levels to tasks
+		std::uint32_t build_top(std::uint32_t begin, std::uint32_t end, std::size_t depth, std::vector<triangle_bvh::node> & nodes, std::vector<task> & tasks)
+		{
+			std::uint32_t const index = nodes.size();
+			if (end - begin <= parallel_threshold || depth == parallel_depth)
+			{
+				nodes.push_back({glm::vec3(0.f), std::uint32_t(tasks.size()), glm::vec3(0.f), subtree_marker});
+				tasks.push_back({begin, end, depth, {}});
+				return index;
+			}
+
+			box node_bounds;
+			std::uint32_t const middle = split(begin, end, node_bounds);
+			if (middle == end)
+			{
+				nodes.push_back({node_bounds.min, begin, node_bounds.max, end - begin});
+				return index;
+			}
+
+			nodes.push_back({node_bounds.min, 0, node_bounds.max, 0});
+			build_top(begin, middle, depth + 1, nodes, tasks);
+			nodes[index].index = build_top(middle, end, depth + 1, nodes, tasks);
+			return index;
+		}
+	};
+
+	// Copies the top-level tree depth-first into result, splicing in the task subtrees
+	std::uint32_t assemble(std::vector<triangle_bvh::node> const & top, std::uint32_t index,
+		std::vector<builder::task> const & tasks, std::vector<triangle_bvh::node> & result)
+	{
+		auto const & n = top[index];
+		std::uint32_t const position = result.size();
+
+		if (n.count == subtree_marker)
+		{
+			for (auto subtree_node : tasks[n.index].nodes)
+			{
+				if (subtree_node.count == 0)
+					subtree_node.index += position;
+				result.push_back(subtree_node);
+			}
+			return position;
+		}
+
+		result.push_back(n);
+		if (n.count == 0)
+		{
+			assemble(top, index + 1, tasks, result);
+			result[position].index = assemble(top, n.index, tasks, result);
+		}
+		return position;
+	}
+
+#ifdef TRIANGLE_BVH_SSE
+
+	struct ray_data
+	{
+		__m128 origin;
+		__m128 inverse_direction;
+		__m128 t_min;
+		__m128 t_max;
+	};
+
+	ray_data prepare(ray const & r)
+	{
+		glm::vec3 const inverse = 1.f / r.direction;
+		return {
+			_mm_setr_ps(r.origin.x, r.origin.y, r.origin.z, 0.f),
+			_mm_setr_ps(inverse.x, inverse.y, inverse.z, 0.f),
+			_mm_setr_ps(0.f, 0.f, 0.f, r.t_min),
+			_mm_setr_ps(0.f, 0.f, 0.f, 0.f),
+		};
+	}
+
+	// Slab test of all three axes at once. The fourth lanes of the node's min and max hold its
+	// index and count, so they are masked out and replaced with the ray's own interval
+	bool intersect_box(triangle_bvh::node const & n, ray_data const & r, float t_max, float & t_enter)
+	{
+		__m128 const xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+
+		__m128 const t0 = _mm_mul_ps(_mm_sub_ps(_mm_and_ps(_mm_loadu_ps(&n.min.x), xyz), r.origin), r.inverse_direction);
+		__m128 const t1 = _mm_mul_ps(_mm_sub_ps(_mm_and_ps(_mm_loadu_ps(&n.max.x), xyz), r.origin), r.inverse_direction);
+
+		__m128 near = _mm_or_ps(_mm_and_ps(_mm_min_ps(t0, t1), xyz), r.t_min);
+		__m128 far = _mm_or_ps(_mm_and_ps(_mm_max_ps(t0, t1), xyz), _mm_setr_ps(0.f, 0.f, 0.f, t_max));
+
+		near = _mm_max_ps(near, _mm_shuffle_ps(near, near, _MM_SHUFFLE(1, 0, 3, 2)));
+		near = _mm_max_ps(near, _mm_shuffle_ps(near, near, _MM_SHUFFLE(2, 3, 0, 1)));
+		far = _mm_min_ps(far, _mm_shuffle_ps(far, far, _MM_SHUFFLE(1, 0, 3, 2)));
+		far = _mm_min_ps(far, _mm_shuffle_ps(far, far, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		t_enter = _mm_cvtss_f32(near);
+		return t_enter <= _mm_cvtss_f32(far);
+	}
+
+#else
+
+	struct ray_data
+	{
+		glm::vec3 origin;
+		glm::vec3 inverse_direction;
+		float t_min;
+	};
+
+	ray_data prepare(ray const & r)
+	{
+		return {r.origin, 1.f / r.direction, r.t_min};
+	}
+
+	bool intersect_box(triangle_bvh::node const & n, ray_data const & r, float t_max, float & t_enter)
+	{
+		glm::vec3 const t0 = (n.min - r.origin) * r.inverse_direction;
+		glm::vec3 const t1 = (n.max - r.origin) * r.inverse_direction;
+		glm::vec3 const near = glm::min(t0, t1);
+		glm::vec3 const far = glm::max(t0, t1);
+
+		t_enter = std::max({near.x, near.y, near.z, r.t_min});
+		return t_enter <= std::min({far.x, far.y, far.z, t_max});
+	}
+
+#endif
+
+	// Moeller-Trumbore; returns whether the ray hits the triangle within [t_min, t_max]
+	bool intersect_triangle(triangle_bvh::triangle const & tri, ray const & r, float t_max, float & t, float & u, float & v)
+	{
+		glm::vec3 const e1 = tri.v1 - tri.v0;
+		glm::vec3 const e2 = tri.v2 - tri.v0;
+		glm::vec3 const p = glm::cross(r.direction, e2);
+		float const det = glm::dot(e1, p);
+		if (std::abs(det) < 1e-12f)
+			return false;
+
+		float const inverse_det = 1.f / det;
+		glm::vec3 const s = r.origin - tri.v0;
+		u = glm::dot(s, p) * inverse_det;
+		if (u < 0.f || u > 1.f)
+			return false;
+
+		glm::vec3 const q = glm::cross(s, e1);
+		v = glm::dot(r.direction, q) * inverse_det;
+		if (v < 0.f || u + v > 1.f)
+			return false;
+
+		t = glm::dot(e2, q) * inverse_det;
+		return t >= r.t_min && t <= t_max;
+	}
+
+}
+
+triangle_bvh::triangle_bvh(thread_pool & pool, glm::vec3 const * positions, std::uint16_t const * indices, std::size_t index_count)
+{
+	build(pool, positions, indices, index_count);
+}
+
+triangle_bvh::triangle_bvh(thread_pool & pool, glm::vec3 const * positions, std::uint32_t const * indices, std::size_t index_count)
+{
+	build(pool, positions, indices, index_count);
+}
+
+template <typename Index>
+void triangle_bvh::build(thread_pool & pool, glm::vec3 const * positions, Index const * indices, std::size_t index_count)
+{
+	std::size_t const count = index_count / 3;
+	if (count == 0)
+		return;
+
+	builder b;
+	b.bounds.resize(count);
+	b.centroids.resize(count);
+	b.order.resize(count);
+	std::iota(b.order.begin(), b.order.end(), 0);
+
+	pool.parallel_for(count, 4096, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			box & bounds = b.bounds[i];
+			for (int k = 0; k < 3; ++k)
+				bounds.extend(positions[indices[3 * i + k]]);
+			b.centroids[i] = (bounds.min + bounds.max) * 0.5f;
+		}
+	});
+
+	std::vector<node> top;
+	std::vector<builder::task> tasks;
+	b.build_top(0, count, 0, top, tasks);
+
+	// Tasks own disjoint ranges of the triangle order, so they partition it concurrently
+	pool.parallel_for(tasks.size(), 1, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+			b.build(tasks[i].begin, tasks[i].end, tasks[i].depth, tasks[i].nodes);
+	});
+
+	std::size_t node_count = top.size();
+	for (auto const & t : tasks)
+		node_count += t.nodes.size();
+	nodes.reserve(node_count);
+	assemble(top, 0, tasks, nodes);
+
+	triangles.resize(count);
+	triangle_ids = std::move(b.order);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		std::size_t const t = triangle_ids[i];
+		triangles[i] = {positions[indices[3 * t]], positions[indices[3 * t + 1]], positions[indices[3 * t + 2]]};
+	}
+}
+
+std::optional<ray_hit> triangle_bvh::closest_hit(ray const & r) const
+{
+	if (nodes.empty())
+		return std::nullopt;
+
+	ray_data const data = prepare(r);
+
+	std::optional<ray_hit> result;
+	float best = r.t_max;
+
+	struct entry
+	{
+		std::uint32_t node;
+		float t;
+	};
+
+	entry stack[max_depth + 2];
+	std::size_t stack_size = 0;
+
+	float t_root;
+	if (!intersect_box(nodes[0], data, best, t_root))
+		return std::nullopt;
+	stack[stack_size++] = {0, t_root};
+
+	while (stack_size > 0)
+	{
+		auto const [index, t_enter] = stack[--stack_size];
+		if (t_enter > best)
+			continue;
+
+		auto const & n = nodes[index];
+		if (n.count > 0)
+		{
+			for (std::uint32_t i = n.index; i < n.index + n.count; ++i)
+			{
+				float t, u, v;
+				if (intersect_triangle(triangles[i], r, best, t, u, v))
+				{
+					best = t;
+					result = ray_hit{t, triangle_ids[i], u, v};
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first so that it tightens best before the other one is popped
+		float t_left, t_right;
+		bool const hit_left = intersect_box(nodes[index + 1], data, best, t_left);
+		bool const hit_right = intersect_box(nodes[n.index], data, best, t_right);
+
+		if (hit_left && hit_right)
+		{
+			if (t_left <= t_right)
+			{
+				stack[stack_size++] = {n.index, t_right};
+				stack[stack_size++] = {index + 1, t_left};
+			}
+			else
+			{
+				stack[stack_size++] = {index + 1, t_left};
+				stack[stack_size++] = {n.index, t_right};
+			}
+		}
+		else if (hit_left)
+			stack[stack_size++] = {index + 1, t_left};
+		else if (hit_right)
+			stack[stack_size++] = {n.index, t_right};
+	}
+
+	return result;
+}
+
+bool triangle_bvh::any_hit(ray const & r) const
+{
+	if (nodes.empty())
+		return false;
+
+	ray_data const data = prepare(r);
+
+	std::uint32_t stack[max_depth + 2];
+	std::size_t stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0)
+	{
+		auto const & n = nodes[stack[--stack_size]];
+
+		float t_enter;
+		if (!intersect_box(n, data, r.t_max, t_enter))
+			continue;
+
+		if (n.count > 0)
+		{
+			for (std::uint32_t i = n.index; i < n.index + n.count; ++i)
+			{
+				float t, u, v;
+				if (intersect_triangle(triangles[i], r, r.t_max, t, u, v))
+					return true;
+			}
+			continue;
+		}
+
+		stack[stack_size++] = n.index;
+		stack[stack_size++] = &n - nodes.data() + 1;
+	}
+
+	return false;
+}
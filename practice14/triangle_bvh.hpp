@@ -0,0 +1,67 @@
+#pragma once
+
+#include "thread_pool.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+struct ray
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+	float t_min = 0.f;
+	float t_max = std::numeric_limits<float>::infinity();
+};
+
+struct ray_hit
+{
+	// Distance along the ray in units of direction, index of the triangle as passed to the constructor
+	// and barycentric coordinates of the hit relative to its second and third vertices
+	float t;
+	std::uint32_t triangle;
+	float u, v;
+};
+
+// Triangle mesh BVH for ray queries, built with binned SAH. Nodes are stored depth-first:
+// the left child of an interior node follows it, and triangles are copied in leaf order
+struct triangle_bvh
+{
+	struct node
+	{
+		glm::vec3 min;
+		// First triangle of a leaf, or the right child of an interior node
+		std::uint32_t index;
+		glm::vec3 max;
+		// Zero for interior nodes
+		std::uint32_t count;
+	};
+
+	static_assert(sizeof(node) == 32);
+
+	struct triangle
+	{
+		glm::vec3 v0, v1, v2;
+	};
+
+	std::vector<node> nodes;
+	std::vector<triangle> triangles;
+	std::vector<std::uint32_t> triangle_ids;
+
+	// Subtrees below the top levels are built in parallel
+	triangle_bvh(thread_pool & pool, glm::vec3 const * positions, std::uint16_t const * indices, std::size_t index_count);
+	triangle_bvh(thread_pool & pool, glm::vec3 const * positions, std::uint32_t const * indices, std::size_t index_count);
+
+	// Nearest intersection within [t_min, t_max]
+	std::optional<ray_hit> closest_hit(ray const & r) const;
+
+	// Whether anything intersects the ray within [t_min, t_max], e.g. for shadow rays; stops at the first hit
+	bool any_hit(ray const & r) const;
+
+private:
+	template <typename Index>
+	void build(thread_pool & pool, glm::vec3 const * positions, Index const * indices, std::size_t index_count);
+};
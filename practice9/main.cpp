@@ -16,6 +16,7 @@
 #include <cmath>
 #include <fstream>
 #include <sstream>
+#include <limits>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -27,6 +28,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
+#include "shadow.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -67,14 +69,18 @@ void main()
 const char fragment_shader_source[] =
 R"(#version 330 core
 
+uniform mat4 view;
+
 uniform vec3 ambient;
 
 uniform vec3 light_direction;
 uniform vec3 light_color;
 
-uniform mat4 transform;
+// One per cascade, along with the view distance each cascade ends at
+uniform mat4 transform[4];
+uniform float cascade_far[4];
 
-uniform sampler2D shadow_map;
+uniform sampler2DArray shadow_map;
 
 in vec3 position;
 in vec3 normal;
@@ -83,14 +89,19 @@ layout (location = 0) out vec4 out_color;
 
 void main()
 {
-    vec4 shadow_pos = transform * vec4(position, 1.0);
+    float depth = -(view * vec4(position, 1.0)).z;
+    int cascade = 0;
+    while (cascade < 3 && depth > cascade_far[cascade])
+        ++cascade;
+
+    vec4 shadow_pos = transform[cascade] * vec4(position, 1.0);
     shadow_pos /= shadow_pos.w;
     shadow_pos = shadow_pos * 0.5 + vec4(0.5);
 
     bool in_shadow_texture = (shadow_pos.x > 0.0) && (shadow_pos.x < 1.0) && (shadow_pos.y > 0.0) && (shadow_pos.y < 1.0) && (shadow_pos.z > 0.0) && (shadow_pos.z < 1.0);
     float shadow_factor = 1.0;
     if (in_shadow_texture)
-        shadow_factor = (texture(shadow_map, shadow_pos.xy).r < shadow_pos.z) ? 0.0 : 1.0;
+        shadow_factor = (texture(shadow_map, vec3(shadow_pos.xy, cascade)).r < shadow_pos.z) ? 0.0 : 1.0;
 
     vec3 albedo = vec3(1.0, 1.0, 1.0);
 
@@ -114,12 +125,14 @@ vec2 vertices[6] = vec2[6](
     vec2(-1.0,  1.0)
 );
 
+uniform int layer;
+
 out vec2 texcoord;
 
 void main()
 {
     vec2 position = vertices[gl_VertexID];
-    gl_Position = vec4(position * 0.25 + vec2(-0.75, -0.75), 0.0, 1.0);
+    gl_Position = vec4(position * 0.125 + vec2(-0.875 + 0.25 * layer, -0.875), 0.0, 1.0);
     texcoord = position * 0.5 + vec2(0.5);
 }
 )";
@@ -127,7 +140,8 @@ void main()
 const char debug_fragment_shader_source[] =
 R"(#version 330 core
 
-uniform sampler2D shadow_map;
+uniform sampler2DArray shadow_map;
+uniform int layer;
 
 in vec2 texcoord;
 
@@ -135,7 +149,7 @@ layout (location = 0) out vec4 out_color;
 
 void main()
 {
-    out_color = vec4(texture(shadow_map, texcoord).rrr, 1.0);
+    out_color = vec4(texture(shadow_map, vec3(texcoord, layer)).rrr, 1.0);
 }
 )";
 
@@ -243,6 +257,7 @@ int main() try
     GLuint view_location = glGetUniformLocation(program, "view");
     GLuint projection_location = glGetUniformLocation(program, "projection");
     GLuint transform_location = glGetUniformLocation(program, "transform");
+    GLuint cascade_far_location = glGetUniformLocation(program, "cascade_far");
 
     GLuint ambient_location = glGetUniformLocation(program, "ambient");
     GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
@@ -258,6 +273,7 @@ int main() try
     auto debug_program = create_program(debug_vertex_shader, debug_fragment_shader);
 
     GLuint debug_shadow_map_location = glGetUniformLocation(debug_program, "shadow_map");
+    GLuint debug_layer_location = glGetUniformLocation(debug_program, "layer");
 
     glUseProgram(debug_program);
     glUniform1i(debug_shadow_map_location, 0);
@@ -273,6 +289,15 @@ int main() try
     std::string scene_path = project_root + "/bunny.obj";
     obj_data scene = parse_obj(scene_path);
 
+    glm::vec3 scene_min(std::numeric_limits<float>::infinity());
+    glm::vec3 scene_max(-std::numeric_limits<float>::infinity());
+    for (auto const & vertex : scene.vertices)
+    {
+        glm::vec3 const position(vertex.position[0], vertex.position[1], vertex.position[2]);
+        scene_min = glm::min(scene_min, position);
+        scene_max = glm::max(scene_max, position);
+    }
+
     GLuint vao, vbo, ebo;
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
@@ -294,20 +319,23 @@ int main() try
     glGenVertexArrays(1, &debug_vao);
 
     GLsizei shadow_map_resolution = 1024;
+    // Must match the array sizes in the fragment shader
+    int const cascade_count = 4;
+    float const cascade_lambda = 0.5f;
 
     GLuint shadow_map;
     glGenTextures(1, &shadow_map);
-    glBindTexture(GL_TEXTURE_2D, shadow_map);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, shadow_map_resolution, shadow_map_resolution, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_map);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, shadow_map_resolution, shadow_map_resolution, cascade_count, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
 
     GLuint shadow_fbo;
     glGenFramebuffers(1, &shadow_fbo);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadow_fbo);
-    glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow_map, 0);
+    glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow_map, 0, 0);
     if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         throw std::runtime_error("Incomplete framebuffer!");
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
@@ -322,6 +350,12 @@ int main() try
     float view_elevation = glm::radians(45.f);
     float view_azimuth = 0.f;
     float camera_distance = 1.5f;
+
+    std::vector<std::uint32_t> casters;
+
+    // Cascades keep their content until the light turns by a degree or something they cover changes
+    shadow_cache cache(cascade_count, glm::radians(1.f));
+
     bool running = true;
     while (running)
     {
@@ -374,8 +408,29 @@ int main() try
 
         glm::vec3 light_direction = glm::normalize(glm::vec3(std::cos(time * 0.5f), 1.f, std::sin(time * 0.5f)));
 
+        float near = 0.01f;
+        float far = 10.f;
+
+        glm::mat4 view(1.f);
+        view = glm::translate(view, {0.f, 0.f, -camera_distance});
+        view = glm::rotate(view, view_elevation, {1.f, 0.f, 0.f});
+        view = glm::rotate(view, view_azimuth, {0.f, 1.f, 0.f});
+
+        glm::mat4 projection = glm::mat4(1.f);
+        projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, near, far);
+
+        auto cascades = fit_shadow_cascades(cache.light_direction(light_direction), projection * view, near, far, cascade_count, cascade_lambda,
+            scene_min, scene_max, shadow_map_resolution);
+
+        std::vector<glm::mat4> transform;
+        std::vector<float> cascade_far;
+        for (auto const & cascade : cascades)
+        {
+            transform.push_back(cascade.transform);
+            cascade_far.push_back(cascade.far);
+        }
+
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadow_fbo);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glViewport(0, 0, shadow_map_resolution, shadow_map_resolution);
 
         glEnable(GL_DEPTH_TEST);
@@ -384,28 +439,34 @@ int main() try
         glEnable(GL_CULL_FACE);
         glCullFace(GL_BACK);
 
-        glm::vec3 light_z = -light_direction;
-        glm::vec3 light_x = glm::normalize(glm::cross(light_z, {0.f, 1.f, 0.f}));
-        glm::vec3 light_y = glm::cross(light_x, light_z);
-        float shadow_scale = 2.f;
+        glUseProgram(shadow_program);
+        glUniformMatrix4fv(shadow_model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
+        glBindVertexArray(vao);
 
-        glm::mat4 transform = glm::mat4(1.f);
-        for (size_t i = 0; i < 3; ++i)
+        bool shadow_map_changed = false;
+        for (int i = 0; i < cascade_count; ++i)
         {
-            transform[i][0] = shadow_scale * light_x[i];
-            transform[i][1] = shadow_scale * light_y[i];
-            transform[i][2] = shadow_scale * light_z[i];
-        }
+            if (!cache.needs_update(i, transform[i]))
+                continue;
+            shadow_map_changed = true;
 
-        glUseProgram(shadow_program);
-        glUniformMatrix4fv(shadow_model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
-        glUniformMatrix4fv(shadow_transform_location, 1, GL_FALSE, reinterpret_cast<float *>(&transform));
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow_map, 0, i);
+            glClear(GL_DEPTH_BUFFER_BIT);
 
-        glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
+            // The whole scene is a single caster
+            cull_shadow_casters(transform[i], &scene_min, &scene_max, 1, casters);
+            if (casters.empty())
+                continue;
+
+            glUniformMatrix4fv(shadow_transform_location, 1, GL_FALSE, reinterpret_cast<float *>(&transform[i]));
+            glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
+        }
 
-        glBindTexture(GL_TEXTURE_2D, shadow_map);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        if (shadow_map_changed)
+        {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_map);
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        }
 
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
         glViewport(0, 0, width, height);
@@ -419,24 +480,14 @@ int main() try
         glEnable(GL_CULL_FACE);
         glCullFace(GL_BACK);
 
-        float near = 0.01f;
-        float far = 10.f;
-
-        glm::mat4 view(1.f);
-        view = glm::translate(view, {0.f, 0.f, -camera_distance});
-        view = glm::rotate(view, view_elevation, {1.f, 0.f, 0.f});
-        view = glm::rotate(view, view_azimuth, {0.f, 1.f, 0.f});
-
-        glm::mat4 projection = glm::mat4(1.f);
-        projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, near, far);
-
-        glBindTexture(GL_TEXTURE_2D, shadow_map);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_map);
 
         glUseProgram(program);
         glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
         glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
-        glUniformMatrix4fv(transform_location, 1, GL_FALSE, reinterpret_cast<float *>(&transform));
+        glUniformMatrix4fv(transform_location, cascade_count, GL_FALSE, reinterpret_cast<float *>(transform.data()));
+        glUniform1fv(cascade_far_location, cascade_count, cascade_far.data());
 
         glUniform3f(ambient_location, 0.2f, 0.2f, 0.2f);
         glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
@@ -446,13 +497,21 @@ int main() try
         glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
 
         glUseProgram(debug_program);
-        glBindTexture(GL_TEXTURE_2D, shadow_map);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_map);
         glBindVertexArray(debug_vao);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        for (int i = 0; i < cascade_count; ++i)
+        {
+            glUniform1i(debug_layer_location, i);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
 
         SDL_GL_SwapWindow(window);
     }
 
+    auto const & shadow_stats = cache.stats();
+    std::cout << "Shadow cascades: " << shadow_stats.rendered << " rendered, " << shadow_stats.reused << " reused over "
+        << shadow_stats.frames << " frames" << std::endl;
+
     SDL_GL_DeleteContext(gl_context);
     SDL_DestroyWindow(window);
 }
@@ -0,0 +1,248 @@
+#include "shadow.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+#include <glm/matrix.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/vector_relational.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+    // Number of steps the scene extent is divided into when rounding the covered extent up
+    constexpr float extent_steps = 64.f;
+    // Same for the depth range of cascades, relative to the size of their slice of the view frustum
+    constexpr float cascade_extent_steps = 16.f;
+
+    std::array<glm::vec3, 8> frustum_corners(glm::mat4 const & view_projection)
+    {
+        glm::mat4 const inverse = glm::inverse(view_projection);
+
+        std::array<glm::vec3, 8> result;
+        for (int i = 0; i < 8; ++i)
+        {
+            glm::vec4 const corner = inverse * glm::vec4((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f, 1.f);
+            result[i] = glm::vec3(corner) / corner.w;
+        }
+        return result;
+    }
+
+    std::array<glm::vec3, 8> box_corners(glm::vec3 const & min, glm::vec3 const & max)
+    {
+        std::array<glm::vec3, 8> result;
+        for (int i = 0; i < 8; ++i)
+            result[i] = {(i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z};
+        return result;
+    }
+
+    // Light-space bounds of a set of points
+    void light_bounds(light_basis const & basis, std::array<glm::vec3, 8> const & points, glm::vec3 & min, glm::vec3 & max)
+    {
+        min = glm::vec3(std::numeric_limits<float>::infinity());
+        max = -min;
+        for (auto const & p : points)
+        {
+            glm::vec3 const q{glm::dot(basis.x, p), glm::dot(basis.y, p), glm::dot(basis.z, p)};
+            min = glm::min(min, q);
+            max = glm::max(max, q);
+        }
+    }
+
+    // Orthographic transform covering the light-space intersection of the receiver corners and the scene,
+    // with an origin snapped to whole texels. The extent is the given one clamped to the scene, or when zero,
+    // the fitted region's rounded up to a multiple of step
+    glm::mat4 fit(light_basis const & basis, std::array<glm::vec3, 8> const & receivers,
+        glm::vec3 const & scene_min, glm::vec3 const & scene_max, float step, float extent, int resolution)
+    {
+        glm::vec3 receiver_min, receiver_max;
+        light_bounds(basis, receivers, receiver_min, receiver_max);
+
+        glm::vec3 scene_light_min, scene_light_max;
+        light_bounds(basis, box_corners(scene_min, scene_max), scene_light_min, scene_light_max);
+
+        // Receivers are limited to both boxes; casters outside the frustum may still shadow it, so the depth
+        // range starts at the scene's side closest to the light
+        glm::vec3 min = glm::max(receiver_min, scene_light_min);
+        glm::vec3 max = glm::min(receiver_max, scene_light_max);
+        min.z = scene_light_min.z;
+        if (min.x >= max.x || min.y >= max.y || min.z >= max.z)
+        {
+            // Nothing visible: any valid transform will do
+            min = scene_light_min;
+            max = scene_light_max;
+        }
+
+        // The far side follows the receivers, so it is rounded up as well to keep it from changing every frame
+        max.z = min.z + std::max(1.f, std::ceil((max.z - min.z) / step)) * step;
+
+        // One texel is left spare for snapping the corner down
+        float const fitted_size = (extent > 0.f)
+            ? std::min(extent, std::max(scene_light_max.x - scene_light_min.x, scene_light_max.y - scene_light_min.y))
+            : std::ceil(std::max(max.x - min.x, max.y - min.y) / step) * step;
+        float const texel = fitted_size / (resolution - 1);
+        float const size = texel * resolution;
+
+        // Centre the square on the fitted region, then snap its corner to whole texels
+        glm::vec2 const center = (glm::vec2(min) + glm::vec2(max)) * 0.5f;
+        glm::vec2 const origin = glm::floor((center - fitted_size * 0.5f) / texel) * texel;
+
+        glm::mat4 result(1.f);
+        for (int i = 0; i < 3; ++i)
+        {
+            result[i][0] = 2.f * basis.x[i] / size;
+            result[i][1] = 2.f * basis.y[i] / size;
+            result[i][2] = 2.f * basis.z[i] / (max.z - min.z);
+        }
+        result[3][0] = -2.f * origin.x / size - 1.f;
+        result[3][1] = -2.f * origin.y / size - 1.f;
+        result[3][2] = -2.f * min.z / (max.z - min.z) - 1.f;
+        return result;
+    }
+
+    // Whether a box overlaps the volume a shadow transform renders
+    bool overlaps(glm::mat4 const & transform, glm::mat3 const & absolute, glm::vec3 const & min, glm::vec3 const & max)
+    {
+        // The transform is affine, so the box maps to a box around its transformed centre
+        glm::vec3 const center = glm::vec3(transform * glm::vec4((min + max) * 0.5f, 1.f));
+        glm::vec3 const extent = absolute * ((max - min) * 0.5f);
+        return glm::all(glm::lessThanEqual(center - extent, glm::vec3(1.f))) && glm::all(glm::greaterThanEqual(center + extent, glm::vec3(-1.f)));
+    }
+
+    glm::mat3 absolute_linear(glm::mat4 const & transform)
+    {
+        glm::mat3 result(transform);
+        for (int i = 0; i < 3; ++i)
+            result[i] = glm::abs(result[i]);
+        return result;
+    }
+
+}
+
+light_basis::light_basis(glm::vec3 const & light_direction)
+{
+    z = -light_direction;
+    // Any perpendicular will do when the light shines straight down
+    glm::vec3 const up = (std::abs(z.y) > 0.999f) ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+    x = glm::normalize(glm::cross(z, up));
+    y = glm::cross(x, z);
+}
+
+glm::mat4 fit_shadow_transform(glm::vec3 const & light_direction, glm::mat4 const & camera_view_projection,
+    glm::vec3 const & scene_min, glm::vec3 const & scene_max, int resolution)
+{
+    float const step = glm::length(scene_max - scene_min) / extent_steps;
+    return fit(light_basis(light_direction), frustum_corners(camera_view_projection), scene_min, scene_max, step, 0.f, resolution);
+}
+
+std::vector<float> cascade_splits(float near, float far, int count, float lambda)
+{
+    std::vector<float> result(count + 1);
+    for (int i = 0; i <= count; ++i)
+    {
+        float const f = float(i) / count;
+        float const logarithmic = near * std::pow(far / near, f);
+        float const uniform = near + (far - near) * f;
+        result[i] = lambda * logarithmic + (1.f - lambda) * uniform;
+    }
+    // Avoid rounding gaps at the ends
+    result.front() = near;
+    result.back() = far;
+    return result;
+}
+
+std::vector<shadow_cascade> fit_shadow_cascades(glm::vec3 const & light_direction, glm::mat4 const & camera_view_projection,
+    float near, float far, int count, float lambda, glm::vec3 const & scene_min, glm::vec3 const & scene_max, int resolution)
+{
+    light_basis const basis(light_direction);
+    auto const corners = frustum_corners(camera_view_projection);
+    auto const splits = cascade_splits(near, far, count, lambda);
+
+    std::vector<shadow_cascade> result(count);
+    for (int i = 0; i < count; ++i)
+    {
+        // View depth is linear along the frustum edges, so slices are interpolated between the near and far corners
+        std::array<glm::vec3, 8> slice;
+        for (int k = 0; k < 4; ++k)
+        {
+            slice[k] = glm::mix(corners[k], corners[k + 4], (splits[i] - near) / (far - near));
+            slice[k + 4] = glm::mix(corners[k], corners[k + 4], (splits[i + 1] - near) / (far - near));
+        }
+
+        // The slice's diameter only depends on the projection, not on where the camera looks, and bounds
+        // its extent in any direction, so the cascade keeps its size as the camera turns
+        float diameter = 0.f;
+        for (auto const & a : slice)
+            for (auto const & b : slice)
+                diameter = std::max(diameter, glm::distance(a, b));
+
+        // Rounded up to 8 significant bits, which rounding errors in the turned corners don't reach
+        int exponent;
+        float const mantissa = std::frexp(diameter, &exponent);
+        diameter = std::ldexp(std::ceil(std::ldexp(mantissa, 8)), exponent - 8);
+
+        result[i].near = splits[i];
+        result[i].far = splits[i + 1];
+        result[i].transform = fit(basis, slice, scene_min, scene_max, diameter / cascade_extent_steps, diameter, resolution);
+    }
+    return result;
+}
+
+void cull_shadow_casters(glm::mat4 const & transform, glm::vec3 const * min, glm::vec3 const * max, std::size_t count,
+    std::vector<std::uint32_t> & casters)
+{
+    casters.clear();
+
+    glm::mat3 const absolute = absolute_linear(transform);
+    for (std::size_t i = 0; i < count; ++i)
+        if (overlaps(transform, absolute, min[i], max[i]))
+            casters.push_back(i);
+}
+
+shadow_cache::shadow_cache(int cascade_count, float light_threshold)
+    : cos_threshold(std::cos(light_threshold))
+    , cascades(cascade_count)
+{}
+
+glm::vec3 shadow_cache::light_direction(glm::vec3 const & current)
+{
+    ++stats_.frames;
+    if (!has_direction || glm::dot(current, direction) < cos_threshold)
+    {
+        direction = current;
+        has_direction = true;
+    }
+    return direction;
+}
+
+void shadow_cache::invalidate(glm::vec3 const & min, glm::vec3 const & max)
+{
+    for (auto & cascade : cascades)
+        if (cascade.valid && overlaps(cascade.transform, absolute_linear(cascade.transform), min, max))
+            cascade.valid = false;
+}
+
+void shadow_cache::invalidate_all()
+{
+    for (auto & cascade : cascades)
+        cascade.valid = false;
+}
+
+bool shadow_cache::needs_update(int index, glm::mat4 const & transform)
+{
+    auto & cascade = cascades[index];
+    if (cascade.valid && cascade.transform == transform)
+    {
+        ++stats_.reused;
+        return false;
+    }
+
+    cascade.transform = transform;
+    cascade.valid = true;
+    ++stats_.rendered;
+    return true;
+}
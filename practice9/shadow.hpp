@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Basis of the light's orthographic view: x and y span the shadow map, z points away from the light
+struct light_basis
+{
+    glm::vec3 x;
+    glm::vec3 y;
+    glm::vec3 z;
+
+    explicit light_basis(glm::vec3 const & light_direction);
+};
+
+// Orthographic world-to-shadow-clip transform fitted to the part of the scene the camera can see.
+// The shadow map covers the intersection of the camera frustum and the scene bounds as seen from the light,
+// and its depth range spans every potential caster between the light and the visible receivers.
+// The covered extent only changes in discrete steps and is snapped to whole texels, so that shadow
+// edges of static geometry do not shimmer as the camera moves
+glm::mat4 fit_shadow_transform(glm::vec3 const & light_direction, glm::mat4 const & camera_view_projection,
+    glm::vec3 const & scene_min, glm::vec3 const & scene_max, int resolution);
+
+// Count + 1 view distances from near to far, blending logarithmic (lambda = 1) and uniform (lambda = 0) splits
+std::vector<float> cascade_splits(float near, float far, int count, float lambda);
+
+struct shadow_cascade
+{
+    // View-space distance range of the receivers in the cascade
+    float near;
+    float far;
+    glm::mat4 transform;
+};
+
+// One fitted transform per slice of the camera frustum between cascade_splits(); near and far must be
+// the distances the camera projection was built with. A cascade's extent is the slice diameter clamped to the
+// scene, so it only depends on the projection, and its depth range changes in steps of a sixteenth of that
+std::vector<shadow_cascade> fit_shadow_cascades(glm::vec3 const & light_direction, glm::mat4 const & camera_view_projection,
+    float near, float far, int count, float lambda, glm::vec3 const & scene_min, glm::vec3 const & scene_max, int resolution);
+
+// Indices of the boxes that overlap the volume a shadow transform renders
+void cull_shadow_casters(glm::mat4 const & transform, glm::vec3 const * min, glm::vec3 const * max, std::size_t count,
+    std::vector<std::uint32_t> & casters);
+
+struct shadow_cache_stats
+{
+    std::uint64_t frames = 0;
+    // Cascade passes drawn, and skipped because the cascade still held the same content
+    std::uint64_t rendered = 0;
+    std::uint64_t reused = 0;
+};
+
+// Tracks which shadow cascades are still valid, so that a static scene under a still light
+// re-renders none of them. A cascade is redrawn when its transform changes, or when a changed caster
+// overlaps it. With the fixed extents and texel snapping of fit_shadow_cascades(), a moving camera only
+// changes the transform when the covered region shifts by a whole texel or its depth range by a step.
+// Small light rotations are absorbed by fitting with a lagging light direction
+struct shadow_cache
+{
+    // light_threshold is the angle in radians the light may turn before the cascades follow it
+    shadow_cache(int cascade_count, float light_threshold);
+
+    // Starts a frame; returns the direction to fit the cascades with
+    glm::vec3 light_direction(glm::vec3 const & current);
+
+    // Marks the cascades overlapping a box as dirty; for a moved caster, call with both its old and new bounds
+    void invalidate(glm::vec3 const & min, glm::vec3 const & max);
+    void invalidate_all();
+
+    // Whether the cascade must be rendered with this transform; assumes it will be if true
+    bool needs_update(int cascade, glm::mat4 const & transform);
+
+    shadow_cache_stats const & stats() const
+    {
+        return stats_;
+    }
+
+private:
+    struct cascade_state
+    {
+        glm::mat4 transform;
+        bool valid = false;
+    };
+
+    float cos_threshold;
+    glm::vec3 direction{0.f};
+    bool has_direction = false;
+    std::vector<cascade_state> cascades;
+    shadow_cache_stats stats_;
+};